@@ -0,0 +1,140 @@
+/**
+ *  @file
+ *  @brief Host test for the coroutine layer of the ESP8266 module
+ *  @author Joern Hoffmann <jhoffmann@informatik.uni-leipzig.de>
+ *  @author Joern Hoffmann <j.hoffmann@xceeth.com>
+ *  @version 1.0
+ *
+ *  @section LICENSE
+ *
+ *  The MIT License (MIT)
+ *  Copyright (c) 2015 Joern Hoffmann
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+// The coroutines need C++20, which the Arduino toolchains lack. This test is
+// built on the host, see README.md in this directory.
+
+#include <ArduinoUnit.h>
+
+#include <EspCoroutine.h>
+#include <utility/FakeSerial.h>
+
+// -------------------------------------------------------------------------- //
+// Helper
+// -------------------------------------------------------------------------- //
+
+// Connects and stores the result: -1 while suspended, 1 or 0 after resuming.
+EspTask connectOnce(EspCoroutine<FakeSerial> &esp, int &result)
+{
+  result = -1;
+  result = (co_await esp.connect(1, "10.0.0.1", 80)) ? 1 : 0;
+}
+
+// -------------------------------------------------------------------------- //
+// Tests
+// -------------------------------------------------------------------------- //
+test (coroutine_connect_resumesWhenCommandSucceeds)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  EspCoroutine<FakeSerial> co(fakeEsp);
+  EspScheduler scheduler;
+  scheduler.attach(fakeEsp);
+
+  int result = -2;
+  scheduler.spawn(connectOnce(co, result));
+
+  // The coroutine waits for the reply of AT+CIPSTART
+  scheduler.runOnce();
+  scheduler.runOnce();
+  assertEqual(result, -1);
+  assertEqual(scheduler.size(), 1);
+
+  fakeSerial.nextBytes("1,CONNECT\r\n\r\nOK\r\n");
+  scheduler.runOnce();
+
+  assertEqual(result, 1);
+  assertEqual(scheduler.size(), 0);
+  assertTrue(fakeEsp.isConnected(1));
+}
+
+test (coroutine_connect_resumesWhenCommandFails)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  EspCoroutine<FakeSerial> co(fakeEsp);
+  EspScheduler scheduler;
+  scheduler.attach(fakeEsp);
+
+  int result = -2;
+  scheduler.spawn(connectOnce(co, result));
+  scheduler.runOnce();
+  assertEqual(result, -1);
+
+  fakeSerial.nextBytes("\r\nERROR\r\n");
+  scheduler.runOnce();
+
+  assertEqual(result, 0);
+  assertEqual(scheduler.size(), 0);
+}
+
+test (coroutine_connect_waitsForFullQueue)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  EspCoroutine<FakeSerial> co(fakeEsp);
+  EspScheduler scheduler;
+  scheduler.attach(fakeEsp);
+
+  for (unsigned i = 0; i < ESP8266_COMMAND_QUEUE_SIZE; i++)
+    assertNotEqual(fakeEsp.isOkAsync(), 0);
+
+  // AT+CIPSTART is queued once the first AT finished
+  int result = -2;
+  scheduler.spawn(connectOnce(co, result));
+  scheduler.runOnce();
+  assertEqual(result, -1);
+
+  fakeSerial.nextBytes("\r\nOK\r\n");
+  scheduler.runOnce();
+  assertEqual(result, -1);
+
+  while (fakeEsp.isBusy()) {
+    fakeSerial.nextBytes(fakeSerial.getWrittenString().endsWith("AT+CIPSTART=1,\"TCP\",\"10.0.0.1\",80\r\n") ? "1,CONNECT\r\n\r\nOK\r\n" : "\r\nOK\r\n");
+    scheduler.runOnce();
+  }
+
+  scheduler.runOnce();
+  assertEqual(result, 1);
+  assertTrue(fakeEsp.isConnected(1));
+}
+
+// -------------------------------------------------------------------------- //
+// Main
+// -------------------------------------------------------------------------- //
+int main()
+{
+  while (Test::getCurrentPassed() + Test::getCurrentFailed() + Test::getCurrentSkipped() < Test::getCurrentCount())
+    Test::run();
+
+  return Test::getCurrentFailed() ? 1 : 0;
+}
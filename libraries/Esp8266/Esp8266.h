@@ -33,6 +33,53 @@
 #define __ESP8266_H__
 
 #include <Stream.h>
+#include <utility/RingBuffer.h>
+#include <utility/CommandFormatter.h>
+#include <utility/SerialTraits.h>
+#include <utility/ReplyMatcher.h>
+
+#ifndef ESP8266_LINE_BUFFER_SIZE
+#define ESP8266_LINE_BUFFER_SIZE 64   ///< Maximum length of a reply line, longer lines are truncated
+#endif
+
+#ifndef ESP8266_DATA_CHUNK_SIZE
+#define ESP8266_DATA_CHUNK_SIZE 16    ///< Bytes of received IP data that are passed to the data handler at once
+#endif
+
+#ifndef ESP8266_RECEIVE_BUFFER_SIZE
+#define ESP8266_RECEIVE_BUFFER_SIZE 32  ///< Bytes of received IP data that are buffered per channel
+#endif
+
+#define ESP8266_CHANNEL_COUNT 5       ///< Link ids 0..4 of the module
+
+#ifndef ESP8266_DATAGRAM_QUEUE_SIZE
+#define ESP8266_DATAGRAM_QUEUE_SIZE 4 ///< Received datagrams of all channels that readDatagram() can tell apart
+#endif
+
+#ifndef ESP8266_COMMAND_QUEUE_SIZE
+#define ESP8266_COMMAND_QUEUE_SIZE 4  ///< Commands that can be queued, preferably a power of two
+#endif
+
+#ifndef ESP8266_COMMAND_BUFFER_SIZE
+#define ESP8266_COMMAND_BUFFER_SIZE 128 ///< Characters of all queued commands
+#endif
+
+// Define ESP8266_BAUD_EEPROM_ADDRESS before including this file to persist the
+// last working baud rate (4 bytes) in the EEPROM at the given address.
+// Define ESP8266_JOIN_EEPROM_ADDRESS to persist the access point of
+// rejoinAccessPoint() (11 bytes) the same way, e.g. across deep sleep.
+#if defined(ESP8266_BAUD_EEPROM_ADDRESS) || defined(ESP8266_JOIN_EEPROM_ADDRESS)
+#include <EEPROM.h>
+#endif
+
+// Define ESP8266_DNS_CACHE_SIZE before including this file to cache the
+// addresses of that many host names (16 bytes each). connect() resolves a host
+// name once and connects by address until ESP8266_DNS_CACHE_TTL has passed.
+#ifdef ESP8266_DNS_CACHE_SIZE
+#ifndef ESP8266_DNS_CACHE_TTL
+#define ESP8266_DNS_CACHE_TTL 300000UL  ///< Milliseconds a resolved address is used
+#endif
+#endif
 
 template <class T>
 class Esp8266
@@ -41,6 +88,13 @@ public:
   static const unsigned long DEFAULT_TIMEOUT =  1000;  ///< Timeout to send simple commands to the module, e.g. isOK()
   static const unsigned long MEDIUM_TIMEOUT  =  5000;  ///< Timemout for medium lasting commands, e.g. connect()
   static const unsigned long LONG_TIMEOUT    = 10000;  ///< Timeout for long commenads, e.g. joinAccessPoint()
+  static const unsigned long PROBE_TIMEOUT   =   150;  ///< Timeout to probe a baud rate in configureBaud()
+  static const unsigned long IPD_TIMEOUT     =   100;  ///< Longest pause within the payload of a "+IPD" message
+  static const unsigned LINK_TEST_ROUNDS     =     4;  ///< Echo rounds of testLink()
+  static const unsigned MAX_SEND_SIZE        =  2048;  ///< Maximum length of one AT+CIPSEND
+  static const unsigned char NO_LINK         =  0xFF;  ///< Returned by openLink() if no channel could be used
+  static const unsigned long PASSTHROUGH_GUARD_TIME =   50;  ///< Silence around "+++" in endPassthrough()
+  static const unsigned long PASSTHROUGH_EXIT_TIME  = 1000;  ///< Delay after "+++" before the next command
 
   typedef enum {
     TCP,            ///< Transmission control protocol for stateful communications (default)
@@ -48,6 +102,74 @@ public:
     UDP             ///< User datagram protocol for connection-less communications
   } ProtocolMode;
 
+  typedef enum {
+    IDLE,           ///< No command was submitted yet
+    PENDING,        ///< A command is in progress, keep calling poll()
+    SUCCEEDED,          ///< The module answered with "OK"
+    FAILED,             ///< The module answered with "ERROR" or "FAIL"
+    TIMED_OUT,          ///< The module did not answer in time
+    SEND_FAILED,        ///< The module answered with "SEND FAIL", the data was not sent
+    ALREADY_CONNECTED,  ///< The module answered with "ALREADY CONNECTED" and "ERROR"
+    BUSY,               ///< The module answered with "busy p..." or "busy s...", retry later
+    NOT_CONNECTED       ///< The link was known to be closed, the data was not sent
+  } CommandStatus;
+
+  typedef enum {
+    LINK_DOWN,          ///< The link is closed or was never opened
+    LINK_OPENING,       ///< AT+CIPSTART of the link is in progress
+    LINK_UP             ///< The module reported the link as connected
+  } LinkState;
+
+  typedef enum {
+    JOIN_FAILED,    ///< The access point could not be joined
+    JOIN_KEPT,      ///< The module was associated already, e.g. by its autoconnect
+    JOIN_FAST,      ///< The known access point (BSSID) was joined directly
+    JOIN_FULL       ///< The access point was joined after a full scan
+  } JoinMode;
+
+  /// Identifies a submitted command, 0 if the command could not be queued.
+  typedef unsigned CommandId;
+
+  /// Called by poll() when an asynchronous command has finished.
+  typedef void (*CommandCallback)(CommandId id, CommandStatus status);
+
+  typedef enum {
+    LINK_CONNECTED,     ///< "<id>,CONNECT" a connection was established
+    LINK_CLOSED,        ///< "<id>,CLOSED" a connection was closed
+    WIFI_CONNECTED,     ///< "WIFI CONNECTED" the module joined an access point
+    WIFI_GOT_IP,        ///< "WIFI GOT IP" the module got an IP address
+    WIFI_DISCONNECTED,  ///< "WIFI DISCONNECT" the module left the access point
+    MODULE_READY,       ///< "ready" the module was reset
+    LINK_ACCEPTED,      ///< "<id>,CONNECT" a client connected to the server
+    EVENT_COUNT
+  } Event;
+
+  /**
+   * Called by poll() for an unsolicited message of the module.
+   * @param channelId The channel of a link event, 0 for all other events.
+   */
+  typedef void (*EventHandler)(Event event, unsigned char channelId);
+
+  /**
+   * Called by poll() for the payload of an "+IPD" message. Large payloads are
+   * passed in several chunks.
+   */
+  typedef void (*DataHandler)(unsigned char channelId, const char *data, unsigned length);
+
+  /// A buffer of a message that is sent with other buffers by send().
+  typedef struct {
+    const char *data;
+    size_t length;
+    bool progmem;       ///< The buffer is stored in flash memory (PROGMEM)
+  } Segment;
+
+  /// Received data of a channel that did not reach the application.
+  typedef struct {
+    unsigned overruns;            ///< "+IPD" messages that ended before their declared length
+    unsigned long lostBytes;      ///< Payload bytes missing from these messages
+    unsigned long droppedBytes;   ///< Bytes that did not fit into the receive buffer
+  } ReceiveCounters;
+
   /**
    * Constructs an object to handle an ESP8266 module.
    * @param serial The serial interface to which the module is connected.
@@ -67,26 +189,71 @@ public:
    * @note Command: AT
    * @return Returns "true" if the command was successful, "false" otherwise.
    */
-  bool isOk() const;
+  bool isOk();
 
   /**
    * Automatically probes and configures the BAUD rate of the module.
-   * The following rates are probed:
-   *  2400, 4800, 9600, 19200, 38400, 57600 and 115200.
+   * The last working rate is probed first. Afterwards the following rates are
+   * probed in order of their likelihood:
+   *  115200, 9600, 57600, 19200, 38400, 4800 and 2400.
+   *
+   * The rates above 115200 are probed last if SerialTraits<T>::MAX_BAUD allows them.
    *
    * @note: The detected rate is also set to the serial stream.
+   * @note: The last working rate is kept in the EEPROM if ESP8266_BAUD_EEPROM_ADDRESS is defined.
    * @return The found BAUD rate of the module. 0 if the module does not answer.
    */
-   unsigned long configureBaud() const;
+   unsigned long configureBaud();
+
+   /**
+    * Returns the last working baud rate, set by configureBaud() or setBaud().
+    * @return The baud rate or 0 if it is unknown.
+    */
+   unsigned long getBaud() const;
 
    /**
     * Changes the baud rate of the pair: connection and module.
-    * @note Command: AT+UART_CUR=<baud>,8,1,0,0
+    *
+    * With flow control the module stops sending while the serial raises RTS,
+    * so bursts of "+IPD" data do not overrun the receive buffer at high rates.
+    * It requires SerialFlowControl<T> and the RTS/CTS lines to be wired. If
+    * the module does not answer with flow control, it is switched to the new
+    * rate without it and "false" is returned.
+    *
+    * @note Command: AT+UART_CUR=<baud>,8,1,0,<0|3>
     * @parameter baud The new baud rate to set. The following rates are
-    *   supported: 2400, 4800, 9600, 19200, 38400, 57600 and 115200.
+    *   supported: 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400,
+    *   460800 and 921600, up to SerialTraits<T>::MAX_BAUD.
+    * @parameter flowControl "true" to enable RTS/CTS flow control.
     * @return True if the command was successful
     */
-   bool setBaud(unsigned long baud) const;
+   bool setBaud(unsigned long baud, bool flowControl = false);
+
+   /**
+    * Returns "true" if the last setBaud() enabled RTS/CTS flow control.
+    */
+   bool isFlowControlEnabled() const;
+
+   /**
+    * Steps the baud rate up through 230400, 460800 and 921600 as long as the
+    * link stays free of errors. Each rate is verified with testLink(); at the
+    * first error the last clean rate is restored.
+    *
+    * @param maxBaud The highest rate to try, at most the one of SerialTraits<T>.
+    * @return The negotiated baud rate. 0 if the module does not answer.
+    */
+   unsigned long negotiateBaud(unsigned long maxBaud = SerialTraits<T>::MAX_BAUD);
+
+   /**
+    * Measures the quality of the link with an echo test. A test command is
+    * sent several times and its echo compared byte by byte.
+    *
+    * @note Command: ATE1 and AT+LINKTEST=<pattern>
+    * @note Unsolicited messages that arrive during the test are dropped.
+    * @param rounds The count of test commands.
+    * @return The count of wrong or missing bytes, 0 for a clean link.
+    */
+   unsigned long testLink(unsigned rounds = LINK_TEST_ROUNDS);
 
   /**
    * Sets the multiple connection support of the module.
@@ -104,7 +271,21 @@ public:
    * @param multipleConnections Reference to store the state. "true" = enabled, "false" = disabled.
    * @return Returns "true" if the command was successful, "false" otherwise.
    */
-  bool getMultipleConnections(bool &multipleConnections) const;
+  bool getMultipleConnections(bool &multipleConnections);
+
+  /**
+   * Resolves the IPv4 address of a host. Dotted-quad addresses, e.g.
+   * "192.168.4.1", are parsed without a command. If ESP8266_DNS_CACHE_SIZE is
+   * defined, the address is taken from the cache if possible and cached
+   * afterwards.
+   *
+   * @note: Command: AT+CIPDOMAIN="<host>"
+   * @param host The DNS name or address of the host.
+   * @param address Reference to store the address. The first octet is the
+   *        lowest byte, as for IPAddress(uint32_t).
+   * @return Returns "true" if the address was resolved, "false" otherwise.
+   */
+  bool resolve(const String &host, unsigned long &address);
 
    /**
     * Joins the given access point.
@@ -114,7 +295,35 @@ public:
     * @param passwd The password to join the network.
     * @return Returns "true" if the command was successful, "false" otherwise.
     */
-   bool joinAccessPoint(const String &ssid, const String &passwd) const;
+   bool joinAccessPoint(const String &ssid, const String &passwd);
+
+   /**
+    * Joins the given access point as fast as possible. Nothing is sent if the
+    * module is associated with it already, e.g. by the autoconnect of the
+    * firmware. Otherwise the access point that was joined last time is joined
+    * by its BSSID, which spares the scan. A full join is the last resort.
+    *
+    * @note: Command: AT+CWJAP_CUR?, AT+CWMODE_CUR=1 and AT+CWJAP_CUR=<ssid>,<passwd>[,<bssid>]
+    * @param ssid The ssid of the access point to join.
+    * @param passwd The password to join the network.
+    * @return How the access point was joined or JOIN_FAILED.
+    */
+   JoinMode rejoinAccessPoint(const String &ssid, const String &passwd);
+
+   /**
+    * Returns the milliseconds the last rejoinAccessPoint() took.
+    */
+   unsigned long getJoinDuration() const;
+
+   /**
+    * Enables the autoconnect of the firmware. The module joins the access
+    * point that was stored with AT+CWJAP_DEF when it starts.
+    *
+    * @note: Command: AT+CWAUTOCONN=<enable>
+    * @param enable "true" to join on start, "false" otherwise.
+    * @return Returns "true" if the command was successful, "false" otherwise.
+    */
+   bool setAutoConnect(bool enable);
 
    /**
     * Establishes a channel to a server.
@@ -126,7 +335,7 @@ public:
     * @param mode The connection mode. Currently TCP or UDP.
     * @return Returns "true" if the command was successful and the connection was established, "false" otherwise.
     */
-   bool connect(unsigned channelId, const String &addr, unsigned int port, ProtocolMode mode = TCP) const;
+   bool connect(unsigned channelId, const String &addr, unsigned int port, ProtocolMode mode = TCP);
 
    /**
     * Establishes a secured (SSL/TLS) connection to a server on port 443.
@@ -137,7 +346,7 @@ public:
     * @param addr The address of the server. Provide either an IP-Address or the DNS name of the server.
     * @return Returns "true" if the connection was established, "false" otherwise.
     */
-   bool connectSecure(unsigned channelId, const String &addr) const;
+   bool connectSecure(unsigned channelId, const String &addr);
 
    /**
     * Diconnects a channel to a server.
@@ -146,7 +355,7 @@ public:
     * @param channelId The channel to disconnect
     * @return Returns "true" if the command was successful, "false" otherwise.
     */
-   bool disconnect(unsigned channelId) const;
+   bool disconnect(unsigned channelId);
 
    /**
     * Sends a buffer to the server.
@@ -157,7 +366,20 @@ public:
     * @param length The length of the buffer
     * @return Returns "true" if the command was successful, "false" otherwise.
     */
-   bool send(unsigned char channelId, const char *bytes, const unsigned length) const;
+   bool send(unsigned char channelId, const char *bytes, const unsigned length);
+
+   /**
+    * Sends a buffer of any length to the server. Buffers larger than
+    * MAX_SEND_SIZE are split into packets; the next packet is announced as
+    * soon as the module confirmed the previous one.
+    *
+    * @note Command: AT+CIPSEND=<id>,<packet length>\r\n ... <bytes> for each packet
+    * @param channelId The channel that is used to send the data.
+    * @param bytes The buffer to send.
+    * @param length The length of the buffer
+    * @return The count of bytes the module confirmed with "SEND OK".
+    */
+   size_t write(unsigned char channelId, const char *bytes, size_t length);
 
    /**
     * Sends a string to the server.
@@ -167,9 +389,537 @@ public:
     * @param string The string to send.
     * @return Returns "true" if the command was successful, "false" otherwise.
     */
-   bool send(unsigned char channelId, const String &string) const;
+   bool send(unsigned char channelId, const String &string);
+
+   /**
+    * Sends a string that is stored in flash memory, e.g. F("..."). The string
+    * is read byte-wise with pgm_read_byte() and never copied into RAM.
+    *
+    * @note Command: AT+CIPSEND=<id>,<length>\r\n ... <bytes>
+    * @param channelId The channel that is used to send the data.
+    * @param string The string to send.
+    * @return Returns "true" if the command was successful, "false" otherwise.
+    */
+   bool send(unsigned char channelId, const __FlashStringHelper *string);
+
+   /**
+    * Sends a buffer that is stored in flash memory (PROGMEM).
+    *
+    * @note Command: AT+CIPSEND=<id>,<length>\r\n ... <bytes>
+    * @param channelId The channel that is used to send the data.
+    * @param bytes The buffer to send.
+    * @param length The length of the buffer
+    * @return Returns "true" if the command was successful, "false" otherwise.
+    */
+   bool send_P(unsigned char channelId, PGM_P bytes, size_t length);
+
+   /**
+    * Sends several buffers as one message without copying them together.
+    * The total length is announced once, then the buffers are written
+    * back-to-back. Buffers in flash memory are read with pgm_read_byte().
+    *
+    * @note Command: AT+CIPSEND=<id>,<total length>\r\n ... <bytes of all segments>
+    * @param channelId The channel that is used to send the data.
+    * @param segments The buffers to send.
+    * @param count The count of segments.
+    * @return Returns "true" if the command was successful, "false" otherwise.
+    */
+   bool send(unsigned char channelId, const Segment *segments, unsigned char count);
+
+   /**
+    * Opens a UDP link whose remote end may change with every datagram. The
+    * given remote is used by send(), sendDatagram() addresses each datagram
+    * on its own.
+    *
+    * @note Command: AT+CIPSTART=<id>,"UDP","<address>",<remote port>,<local port>,2
+    * @param channelId The channel of the link.
+    * @param addr The default remote. Provide either an IP-Address or a DNS name.
+    * @param remotePort The port of the default remote.
+    * @param localPort The port datagrams are received on.
+    * @return Returns "true" if the link was opened, "false" otherwise.
+    */
+   bool openDatagram(unsigned char channelId, const String &addr, unsigned int remotePort, unsigned int localPort);
+
+   /**
+    * Sends one datagram to a given remote over a link of openDatagram().
+    * A datagram is never split, so its length is limited to MAX_SEND_SIZE.
+    *
+    * @note Command: AT+CIPSEND=<id>,<length>,"<address>",<port>\r\n ... <bytes>
+    * @param channelId The channel of the link.
+    * @param bytes The datagram to send.
+    * @param length The length of the datagram.
+    * @param addr The IP-Address of the remote.
+    * @param port The port of the remote.
+    * @return Returns "true" if the command was successful, "false" otherwise.
+    */
+   bool sendDatagram(unsigned char channelId, const char *bytes, size_t length, const String &addr, unsigned int port);
+
+   /**
+    * Sends one datagram to a remote given as returned by getRemote(), e.g. to
+    * answer the sender of a received datagram.
+    *
+    * @note Command: AT+CIPSEND=<id>,<length>,"<address>",<port>\r\n ... <bytes>
+    * @return Returns "true" if the command was successful, "false" otherwise.
+    */
+   bool sendDatagram(unsigned char channelId, const char *bytes, size_t length, unsigned long address, unsigned int port);
+
+   /**
+    * Enables or disables the remote address and port in "+IPD" messages.
+    * poll() keeps the sender of the last message per channel, see getRemote(),
+    * and of each datagram, see readDatagram().
+    *
+    * @note Command: AT+CIPDINFO=<0|1>
+    * @param enable "true" to receive the sender of each message.
+    * @return Returns "true" if the command was successful, "false" otherwise.
+    */
+   bool setRemoteInfo(bool enable);
+
+   /**
+    * Returns the remote of a channel: the address a link was opened with,
+    * the one reported by syncLinks() or, after setRemoteInfo(true), the
+    * sender of the last data received.
+    *
+    * @param channelId The channel to check.
+    * @param address Set to the IP-Address of the remote, first octet in the lowest byte.
+    * @param port Set to the port of the remote.
+    * @return Returns "true" if the remote is known, "false" otherwise.
+    */
+   bool getRemote(unsigned char channelId, unsigned long &address, unsigned int &port) const;
+
+   /**
+    * Reads one datagram that was received on a link of openDatagram(),
+    * together with its sender. The bytes of the datagram that do not fit
+    * into the buffer are discarded. Up to ESP8266_DATAGRAM_QUEUE_SIZE
+    * datagrams are kept apart, further ones are dropped until one is read.
+    *
+    * @param channelId The channel to read from.
+    * @param buffer The buffer to fill.
+    * @param length The size of the buffer.
+    * @param address Set to the IP-Address of the sender, first octet in the
+    *        lowest byte. 0 unless setRemoteInfo(true) was called.
+    * @param port Set to the port of the sender.
+    * @return The count of bytes read, 0 if no complete datagram is available.
+    */
+   unsigned readDatagram(unsigned char channelId, char *buffer, unsigned length, unsigned long &address, unsigned int &port);
+
+   /**
+    * Starts a TCP server. Each client gets a channel of its own; its link is
+    * reported by the LINK_ACCEPTED event and by accept(), its data arrives
+    * like the data of any other link. A server that runs on another port is
+    * stopped first.
+    *
+    * @note Command: AT+CIPMUX=1, AT+CIPSERVER=0 and AT+CIPSERVER=1,<port>
+    * @param port The port to listen on.
+    * @return Returns "true" if the server is listening, "false" otherwise.
+    */
+   bool startServer(unsigned int port);
+
+   /**
+    * Stops the server. Links of connected clients stay open.
+    *
+    * @note Command: AT+CIPSERVER=0
+    * @return Returns "true" if the command was successful, "false" otherwise.
+    */
+   bool stopServer();
+
+   /**
+    * Sets the time after which the module closes a link of the server that
+    * is idle.
+    *
+    * @note Command: AT+CIPSTO=<timeout>
+    * @note The module only accepts the timeout while the server is running.
+    * @param seconds The timeout (0 to 7200), 0 keeps the links open.
+    * @return Returns "true" if the command was successful, "false" otherwise.
+    */
+   bool setServerTimeout(unsigned int seconds);
+
+   /**
+    * Returns the channel of a client that connected to the server and was
+    * not yet returned by accept().
+    *
+    * @return The channel or NO_LINK if no client is waiting.
+    */
+   unsigned char accept();
+
+   /**
+    * Connects to a server in single connection mode and starts the
+    * transparent transmission. Until endPassthrough() every byte written to
+    * getSerial() is sent to the server and every byte read from it comes from
+    * the server. No commands are sent and poll() does nothing meanwhile.
+    *
+    * @note Command: AT+CIPMUX=0, AT+CIPSTART="<type>","<address>",<port>, AT+CIPMODE=1 and AT+CIPSEND
+    * @note Fails while connections of the multiple connection mode are open.
+    * @param addr The address of the server. Provide either an IP-Address or the DNS name of the server.
+    * @param port The port of the service to connect with.
+    * @param mode The connection mode. TCP, TLS or UDP.
+    * @return Returns "true" if the transmission has started, "false" otherwise.
+    */
+   bool beginPassthrough(const String &addr, unsigned int port, ProtocolMode mode = TCP);
+
+   /**
+    * Stops the transparent transmission and closes the connection.
+    *
+    * @note Command: +++, AT+CIPMODE=0 and AT+CIPCLOSE
+    * @return Returns "true" if the module is back in normal mode, "false" otherwise.
+    */
+   bool endPassthrough();
+
+   /**
+    * Returns "true" while the transparent transmission is active.
+    */
+   bool isPassthrough() const;
+
+   /**
+    * Returns the count of received bytes that can be read from a channel.
+    *
+    * @note The receive buffers are filled by poll() if no data handler is set.
+    * @param channelId The channel to check.
+    * @return The count of buffered bytes.
+    */
+   unsigned available(unsigned char channelId) const;
+
+   /**
+    * Reads received bytes of a channel into a given buffer.
+    *
+    * @param channelId The channel to read from.
+    * @param buffer The buffer to be filled.
+    * @param length The size of the buffer.
+    * @return The count of copied bytes.
+    */
+   unsigned read(unsigned char channelId, char *buffer, unsigned length);
+
+   /**
+    * Reads one received byte of a channel.
+    *
+    * @param channelId The channel to read from.
+    * @return The byte or -1 if no byte is available.
+    */
+   int read(unsigned char channelId);
+
+   /**
+    * Returns the next received byte of a channel without removing it.
+    *
+    * @param channelId The channel to read from.
+    * @return The byte or -1 if no byte is available.
+    */
+   int peek(unsigned char channelId) const;
+
+   /**
+    * Returns "true" if the module reported the link of a channel as
+    * connected ("<id>,CONNECT") and not yet as closed ("<id>,CLOSED").
+    *
+    * @note The state is updated by poll().
+    * @param channelId The channel to check.
+    */
+   bool isConnected(unsigned char channelId) const;
+
+   /**
+    * Returns the state of the link of a channel. The state follows the
+    * "CONNECT", "CLOSED", "WIFI DISCONNECT" and "ready" messages of the
+    * module, so a dead link is known before data is written to it; data
+    * queued for a closed link finishes with NOT_CONNECTED at once.
+    *
+    * @note The state is updated by poll().
+    * @param channelId The channel to check.
+    */
+   LinkState getLinkState(unsigned char channelId) const;
+
+   /**
+    * Returns the losses of the received data of a channel. A "+IPD" message
+    * is taken as overrun if its payload pauses for IPD_TIMEOUT or contains
+    * the header of the next message before the declared length arrived,
+    * usually because the serial dropped bytes.
+    * Overruns hint at a baud rate that is too high for the serial, dropped
+    * bytes at a receive buffer that is too small or read too rarely.
+    *
+    * @note The counters are updated by poll().
+    * @param channelId The channel to check.
+    * @return The counters since the start or the last clearReceiveCounters().
+    */
+   ReceiveCounters getReceiveCounters(unsigned char channelId) const;
+
+   /**
+    * Resets the receive counters of all channels.
+    */
+   void clearReceiveCounters();
+
+   /**
+    * Replaces the tracked state of all links by the links the module
+    * reports, e.g. after the sketch restarted while the module kept running.
+    *
+    * @note Command: AT+CIPSTATUS
+    * @return Returns "true" if the command was successful, "false" otherwise.
+    */
+   bool syncLinks();
+
+   /**
+    * Returns an open link to a server, connecting only if necessary. A link
+    * that was opened with the same address, port and protocol before is
+    * reused. Otherwise a free channel is connected; if all channels are in
+    * use, the least recently used link of openLink() is closed first.
+    *
+    * @note Requires the multiple connection mode. Links are closed with
+    *       disconnect() or by the server; the pool forgets them on "CLOSED".
+    * @param addr The address of the server. Provide either an IP-Address or the DNS name of the server.
+    * @param port The port of the service to connect with.
+    * @param mode The connection mode. TCP, TLS or UDP.
+    * @return The channel of the link or NO_LINK if no link could be opened.
+    */
+   unsigned char openLink(const String &addr, unsigned int port, ProtocolMode mode = TCP);
+
+  // ------------------------------------------------------------------------ //
+  // Asynchronous interface
+  //
+  // The *Async() methods only queue a command and return immediately. The
+  // queued commands are sent one after another by poll(), which has to be
+  // called frequently, e.g. from loop(). The next command is sent as soon as
+  // the reply of the previous one arrived. The blocking methods above are thin
+  // wrappers that queue a command and poll until it finished.
+  //
+  // poll() reads every message of the module. Replies are passed to the
+  // command in progress, unsolicited messages like "+IPD" or "1,CLOSED" are
+  // routed to the event and data handlers.
+  // ------------------------------------------------------------------------ //
+
+  /**
+   * Advances the queued commands and dispatches unsolicited messages.
+   * The method never blocks, it only consumes the bytes that are already
+   * available on the serial.
+   *
+   * @note Calls the command callback for each command that has finished.
+   * @return The status of the current or last command.
+   */
+  CommandStatus poll();
+
+  /**
+   * Returns the status of the current or last command without polling.
+   */
+  CommandStatus getCommandStatus() const;
+
+  /**
+   * Returns the status of a submitted command without polling.
+   *
+   * @note The result of a command is kept until ESP8266_COMMAND_QUEUE_SIZE
+   * further commands were submitted.
+   * @param id The id returned by one of the *Async() methods.
+   * @return The status or IDLE if the id is unknown.
+   */
+  CommandStatus getCommandStatus(CommandId id) const;
+
+  /**
+   * Returns the status of the last blocking command, e.g. ALREADY_CONNECTED
+   * if connect() returned "false" because the channel was in use.
+   */
+  CommandStatus getLastStatus() const;
+
+  /**
+   * Returns the count of bytes a send command has delivered so far.
+   *
+   * @param id The id returned by sendAsync().
+   * @return The count of confirmed bytes or 0 if the id is unknown.
+   */
+  size_t getDeliveredBytes(CommandId id) const;
+
+  /**
+   * Returns "true" while commands are queued or in progress.
+   */
+  bool isBusy() const;
+
+  /**
+   * Sets the function that is called by poll() when a command has finished.
+   * @param callback The function to call or NULL to disable the notification.
+   */
+  void setCommandCallback(CommandCallback callback);
+
+  /**
+   * Sets the function that is called for an unsolicited message of the module.
+   * Each event type has its own handler.
+   *
+   * @param event The event type to handle.
+   * @param handler The function to call or NULL to ignore the event.
+   */
+  void setEventHandler(Event event, EventHandler handler);
+
+  /**
+   * Sets the function that receives the IP data sent by a server. The data is
+   * passed to the handler instead of the receive buffers of the channels.
+   *
+   * @param handler The function to call or NULL to use the receive buffers.
+   */
+  void setDataHandler(DataHandler handler);
+
+  /**
+   * Asynchronous version of isOk().
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId isOkAsync();
+
+  /**
+   * Asynchronous version of setMultipleConnections().
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId setMultipleConnectionsAsync(bool value);
+
+  /**
+   * Asynchronous version of joinAccessPoint().
+   * @return The id of the last command of the operation or 0 if the queue is full.
+   */
+  CommandId joinAccessPointAsync(const String &ssid, const String &passwd);
+
+  /**
+   * Asynchronous version of setAutoConnect().
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId setAutoConnectAsync(bool enable);
+
+  /**
+   * Asynchronous version of connect().
+   * @return The id of the last command of the operation or 0 if the queue is full.
+   */
+  CommandId connectAsync(unsigned channelId, const String &addr, unsigned int port, ProtocolMode mode = TCP);
+
+  /**
+   * Asynchronous version of disconnect().
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId disconnectAsync(unsigned channelId);
+
+  /**
+   * Asynchronous version of send() and write(). Buffers larger than
+   * MAX_SEND_SIZE are sent in several packets.
+   *
+   * @note The buffer is not copied. It must stay valid until the command has finished.
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId sendAsync(unsigned char channelId, const char *bytes, size_t length);
+
+  /**
+   * Asynchronous version of send() for a string in flash memory.
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId sendAsync(unsigned char channelId, const __FlashStringHelper *string);
+
+  /**
+   * Asynchronous version of send_P().
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId sendAsync_P(unsigned char channelId, PGM_P bytes, size_t length);
+
+  /**
+   * Asynchronous version of send() for several buffers.
+   *
+   * @note Neither the segments nor their buffers are copied. They must stay
+   *       valid until the command has finished.
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId sendAsync(unsigned char channelId, const Segment *segments, unsigned char count);
+
+  /**
+   * Asynchronous version of openDatagram().
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId openDatagramAsync(unsigned char channelId, const String &addr, unsigned int remotePort, unsigned int localPort);
+
+  /**
+   * Asynchronous version of sendDatagram(). Several datagrams can be queued
+   * at once; each is announced as soon as the module confirmed the previous
+   * one, without a round trip through the sketch.
+   *
+   * @note The buffer is not copied. It must stay valid until the command has finished.
+   * @return The id of the command or 0 if the queue is full or the datagram is too long.
+   */
+  CommandId sendDatagramAsync(unsigned char channelId, const char *bytes, size_t length, const String &addr, unsigned int port);
+
+  /**
+   * Asynchronous version of sendDatagram() for a remote given as returned by getRemote().
+   * @return The id of the command or 0 if the queue is full or the datagram is too long.
+   */
+  CommandId sendDatagramAsync(unsigned char channelId, const char *bytes, size_t length, unsigned long address, unsigned int port);
+
+  /**
+   * Asynchronous version of setRemoteInfo().
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId setRemoteInfoAsync(bool enable);
+
+  /**
+   * Asynchronous version of startServer().
+   * @return The id of the last command of the operation or 0 if the queue is full.
+   */
+  CommandId startServerAsync(unsigned int port);
+
+  /**
+   * Asynchronous version of stopServer().
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId stopServerAsync();
+
+  /**
+   * Asynchronous version of setServerTimeout().
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId setServerTimeoutAsync(unsigned int seconds);
+
+  /**
+   * Asynchronous version of syncLinks().
+   * @return The id of the command or 0 if the queue is full.
+   */
+  CommandId syncLinksAsync();
 
 private:
+  typedef enum {
+    NO_QUERY,
+    QUERY_MULTIPLE_CONNECTIONS,   ///< +CIPMUX:<mode>
+    QUERY_DOMAIN,                 ///< +CIPDOMAIN:<address>
+    QUERY_ACCESS_POINT,           ///< +CWJAP_CUR:"<ssid>","<bssid>",<channel>,<rssi>
+    QUERY_LINK_STATUS             ///< +CIPSTATUS:<id>,"<type>","<address>",<port>,<local port>,<server>
+  } Query;
+
+  /// Settings of the module that were set by the driver, cleared by a reset or the loss of the access point
+  typedef enum {
+    STATE_MULTIPLE_KNOWN      = 0x01,   ///< The connection mode is known
+    STATE_MULTIPLE_ENABLED    = 0x02,   ///< AT+CIPMUX=1
+    STATE_STATION_MODE        = 0x04,   ///< AT+CWMODE_CUR=1
+    STATE_SSL_SIZE            = 0x08,   ///< AT+CIPSSLSIZE=4096
+    STATE_ECHO_KNOWN          = 0x10,   ///< The echo mode is known
+    STATE_ECHO_ENABLED        = 0x20,   ///< ATE1
+    STATE_BAUD                = 0x40,   ///< The module uses the rate of the serial
+    STATE_SERVER              = 0x80    ///< AT+CIPSERVER=1
+  } ModuleState;
+
+  typedef struct {
+    CommandId id;
+    unsigned length;                ///< Characters of the command in the command buffer
+    unsigned long timeout;
+    Query query;                    ///< Information line the command waits for
+    bool chained;                   ///< Not sent if the previous command failed
+    unsigned char stateMask;        ///< Settings of ModuleState the command changes
+    unsigned char stateValue;       ///< Their values after the command, it is not sent if they are set
+    bool passthrough;               ///< Starts the transparent transmission at the prompt of AT+CIPSEND
+    unsigned char channelId;        ///< Channel of AT+CIPSEND or AT+CIPSTART
+    bool opensLink;                 ///< AT+CIPSTART, its "CONNECT" is no client of the server
+    const Segment *segments;        ///< Data to send with AT+CIPSEND, NULL for other commands
+    unsigned char segmentCount;
+    Segment buffer;                 ///< The only segment of a plain buffer
+    size_t payloadLength;           ///< Total length of the segments
+    size_t delivered;               ///< Bytes of the payload confirmed by the module
+  } Command;
+
+  typedef struct {
+    unsigned long hostHash;         ///< Hash of the address of the server as passed to openLink()
+    unsigned long hostCheck;        ///< Second hash of the address, tells apart addresses with the same hostHash
+    unsigned port;                  ///< 0 if the channel is not part of the pool
+    ProtocolMode mode;
+    unsigned long lastUse;          ///< Time of the last openLink() that returned the channel
+  } PooledLink;
+
+  typedef struct {
+    CommandId id;
+    CommandStatus status;
+    bool answered;                  ///< The information line of a query was parsed
+    unsigned long value;            ///< Value of the information line, delivered bytes of a send command
+  } Result;
+
   // Serial Interface
   T &_serial;
   void setTimeout(unsigned int timout) const;
@@ -177,11 +927,149 @@ private:
   void flushIn() const;
   void flushOut() const;
 
+  // Baud rate
+  unsigned long _baud;
+  bool _flowControl;              ///< RTS/CTS is used by the module and the serial
+  void beginSerial(unsigned long baud, bool flowControl);
+  bool probeBaud(unsigned long baud);
+  unsigned long rememberBaud(unsigned long baud);
+  void restoreBaud(unsigned long baud);
+  bool awaitRawLine(PGM_P expected, unsigned long timeout);
+
   // Commands
-  void sendCommand(const String &command) const;
-  const String readReply(unsigned long timeout = DEFAULT_TIMEOUT) const;
-  bool findAnswer(char *anser, unsigned long timeout = DEFAULT_TIMEOUT) const;
-  bool wasCommandSuccessful(unsigned long timeout = DEFAULT_TIMEOUT) const;
+  static const __FlashStringHelper *protocolName(ProtocolMode mode);
+  template <typename ... Types>
+  void sendSetCommand(const __FlashStringHelper *command, const Types &...parameters) const;
+  bool wasCommandSuccessful(CommandId id);
+
+  // Command engine
+  CommandStatus _status;          ///< Status of the first queued command
+  CommandStatus _failure;         ///< Status of an "ERROR" of that command, set by a preceding line
+  CommandStatus _lastStatus;      ///< Status of the last blocking command
+  CommandCallback _callback;
+  unsigned long _deadline;
+  bool _payloadPending;           ///< A packet is written at the prompt of AT+CIPSEND
+  size_t _packetLength;
+  RingBuffer<ESP8266_LINE_BUFFER_SIZE> _line;   ///< Reply line that is assembled
+  ReplyMatcher _matcher;          ///< Token of that line
+  bool _passthrough;              ///< The serial carries the data of the link, not replies
+  unsigned char _moduleState;     ///< Known settings of the module, see ModuleState
+  unsigned _serverPort;           ///< Port of the last started server, 0 if none
+
+  // Command queue
+  Command _commands[ESP8266_COMMAND_QUEUE_SIZE];
+  unsigned char _firstCommand;
+  unsigned char _commandCount;
+  RingBuffer<ESP8266_COMMAND_BUFFER_SIZE> _commandBuffer;   ///< Text of the queued commands
+  Result _results[ESP8266_COMMAND_QUEUE_SIZE];
+  CommandId _lastId;
+
+  // Demultiplexer
+  EventHandler _eventHandlers[EVENT_COUNT];
+  DataHandler _dataHandler;
+  unsigned char _ipdChannel;      ///< Channel of the "+IPD" message that is received
+  unsigned _ipdRemaining;         ///< Payload bytes of that message still to receive
+  unsigned long _ipdDeadline;     ///< The message is overrun if no byte arrives until then
+  unsigned char _ipdMatched;      ///< Characters of a header found at the end of the payload so far
+  unsigned char _ipdMatchStart;   ///< 2 if that header has no line break in front
+  ReceiveCounters _receiveCounters[ESP8266_CHANNEL_COUNT];
+  RingBuffer<ESP8266_RECEIVE_BUFFER_SIZE> _receiveBuffers[ESP8266_CHANNEL_COUNT];
+  unsigned char _connectedLinks;  ///< One bit per channel
+  unsigned char _acceptedLinks;   ///< Clients of the server not yet returned by accept()
+  unsigned char _closedLinks;     ///< Links known to be closed, data for them is not sent
+  bool isOpening(unsigned char channelId) const;
+  void dropLinks(unsigned char links);
+  bool parseLinkStatus(unsigned position, unsigned long &links);
+
+  typedef struct {
+    unsigned long address;          ///< 0 if the sender is unknown
+    unsigned port;
+  } Remote;
+
+  Remote _remotes[ESP8266_CHANNEL_COUNT];   ///< Remote of the link or sender of the last "+IPD" message
+
+  // Datagrams
+  typedef struct {
+    unsigned char channelId;
+    unsigned length;                ///< Bytes of the datagram in the receive buffer of the channel
+    Remote sender;
+  } Datagram;
+
+  Datagram _datagrams[ESP8266_DATAGRAM_QUEUE_SIZE];   ///< In the order of arrival
+  unsigned char _datagramCount;
+  unsigned char _datagramLinks;   ///< Links of openDatagram(), one bit per channel
+  bool _ipdDatagram;              ///< The message that is received is the last entry of _datagrams
+  bool isReceiving(unsigned char index) const;
+  void recordDatagram(const Remote &sender);
+  void removeDatagram(unsigned char index);
+  void consumeDatagrams(unsigned char channelId, unsigned count);
+  void forgetDatagrams(unsigned char channelId);
+
+#ifdef ESP8266_DNS_CACHE_SIZE
+  // DNS cache
+  typedef struct {
+    unsigned long hostHash;
+    unsigned long hostCheck;        ///< Second hash of the host name, tells apart names with the same hostHash
+    unsigned long address;          ///< 0 if the entry is unused
+    unsigned long expiry;
+  } CachedAddress;
+
+  CachedAddress _dnsCache[ESP8266_DNS_CACHE_SIZE];
+  bool findCachedAddress(const String &host, unsigned long &address) const;
+  void cacheAddress(const String &host, unsigned long address);
+#endif
+
+  // Fast rejoin
+  typedef struct {
+    unsigned long ssidHash;
+    unsigned char bssid[6];
+    unsigned char channel;          ///< 1 to 14, other values mark an unknown access point
+  } AccessPoint;
+
+  AccessPoint _accessPoint;       ///< Access point the module was associated with last
+  unsigned long _joinDuration;
+  CommandId queueJoin(const String &ssid, const String &passwd, const unsigned char *bssid);
+  bool queryAccessPoint();
+  bool parseAccessPoint(unsigned position);
+  bool isKnownAccessPoint() const;
+  void rememberAccessPoint();
+
+  // Connection pool
+  PooledLink _pool[ESP8266_CHANNEL_COUNT];
+  unsigned char findPooledLink(const String &host, unsigned port, ProtocolMode mode) const;
+  unsigned char allocateLink();
+
+  bool canQueue(unsigned count) const;
+  Command *queueCommand(const __FlashStringHelper *command, unsigned long timeout = DEFAULT_TIMEOUT);
+  template <typename ... Types>
+  Command *queueSetCommand(unsigned long timeout, const __FlashStringHelper *command, const Types &...parameters);
+  Command *appendCommand(const RingBufferWriter<ESP8266_COMMAND_BUFFER_SIZE> &writer, unsigned long timeout);
+  void unqueueCommand();
+  CommandId submit(const Command *command);
+  Command *changesState(Command *command, unsigned char mask, unsigned char value);
+  void issueCommand();
+  CommandId queueSend(unsigned char channelId, const char *bytes, size_t length, bool progmem);
+  template <typename Address>
+  CommandId queueDatagram(unsigned char channelId, const char *bytes, size_t length, const Address &addr, unsigned port);
+  Command *attachPayload(Command *command, unsigned char channelId, const char *bytes, size_t length, bool progmem);
+  void issuePacket(Command &command);
+  Command &currentCommand();
+  Result &resultOf(CommandId id);
+  void parseReply(char c);
+  void parseLine();
+  bool parseEvent(ReplyToken token);
+  bool parseDataHeader();
+  void receiveData();
+  unsigned char releaseMatch(char *buffer);
+  void abortData(unsigned lost);
+  void deliverData(const char *buffer, unsigned length);
+  void notify(Event event, unsigned char channelId = 0);
+  void parseInformation(ReplyToken token);
+  void writePayload();
+  void writeSegment(const Segment &segment, size_t offset, size_t length);
+  void finishCommand(CommandStatus status);
+  void finishPacket();
+  void dequeueCommand(CommandStatus status);
 };
 
 // Provide template definition
@@ -0,0 +1,116 @@
+/**
+ *  @file
+ *  @brief Arduino Client on top of a channel of an Esp8266 module.
+ *  @author Joern Hoffmann <jhoffmann@informatik.uni-leipzig.de>
+ *  @author Joern Hoffmann <j.hoffmann@xceeth.com>
+ *  @version 1.0
+ *
+ *  @section LICENSE
+ *
+ *  The MIT License (MIT)
+ *  Copyright (c) 2015 Joern Hoffmann
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __ESPCLIENT_H__
+#define __ESPCLIENT_H__
+
+#include <Client.h>
+#include <Esp8266.h>
+
+#ifndef ESP8266_CLIENT_BUFFER_SIZE
+#define ESP8266_CLIENT_BUFFER_SIZE 64 ///< Bytes written by EspClient that are coalesced into one AT+CIPSEND
+#endif
+
+/**
+ * Provides a channel of an Esp8266 module as an Arduino Client, so it can be
+ * passed to libraries that expect e.g. an EthernetClient.
+ *
+ * Small writes are collected in a buffer and sent with one AT+CIPSEND once
+ * the buffer is full, flush() is called or the client is read from. Received
+ * data is read from the receive buffer of the channel, which poll() fills
+ * from "+IPD" messages.
+ */
+template <class T>
+class EspClient : public Client
+{
+public:
+  /**
+   * Constructs a client for a channel of the module.
+   * @param esp The module.
+   * @param channelId The channel used for the connection.
+   */
+  EspClient(Esp8266<T> &esp, unsigned char channelId);
+
+  /**
+   * Connects to a server.
+   * @return Returns 1 if the connection was established, 0 otherwise.
+   */
+  int connect(IPAddress ip, uint16_t port);
+  int connect(const char *host, uint16_t port);
+
+  /**
+   * Buffers the data to send. Writes that are larger than the buffer are sent
+   * directly.
+   * @return The count of accepted bytes.
+   */
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+
+  /**
+   * Returns the count of received bytes. Sends the buffered data and polls
+   * the module first.
+   */
+  int available();
+  int read();
+  int read(uint8_t *buffer, size_t size);
+  int peek();
+
+  /**
+   * Sends the buffered data with one AT+CIPSEND.
+   */
+  void flush();
+
+  /**
+   * Sends the buffered data and closes the connection.
+   */
+  void stop();
+
+  /**
+   * Returns 1 while the connection is open or received data is left to read.
+   */
+  uint8_t connected();
+  operator bool();
+
+private:
+  Esp8266<T> &_esp;
+  unsigned char _channelId;
+  char _writeBuffer[ESP8266_CLIENT_BUFFER_SIZE];
+  unsigned _writeLength;
+
+  bool connect(const String &host, uint16_t port);
+};
+
+// Provide template definition
+#include <utility/EspClient.cpp>
+
+#endif // __ESPCLIENT_H__
@@ -0,0 +1,263 @@
+/**
+ *  @file
+ *  @brief C++20 coroutines on top of the asynchronous interface of Esp8266 modules.
+ *  @author Joern Hoffmann <jhoffmann@informatik.uni-leipzig.de>
+ *  @author Joern Hoffmann <j.hoffmann@xceeth.com>
+ *  @version 1.0
+ *
+ *  @section LICENSE
+ *
+ *  The MIT License (MIT)
+ *  Copyright (c) 2015 Joern Hoffmann
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#ifndef __ESPCOROUTINE_H__
+#define __ESPCOROUTINE_H__
+
+#include <Esp8266.h>
+
+// The coroutine layer is meant for host builds, e.g. a Linux gateway that
+// drives several modules over USB serials. Older compilers skip it.
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <functional>
+#include <vector>
+
+class EspScheduler;
+
+/**
+ * Return type of a coroutine that is run by an EspScheduler. The coroutine
+ * starts suspended and is resumed by the scheduler only.
+ */
+class EspTask
+{
+public:
+  struct promise_type {
+    EspScheduler *scheduler = nullptr;
+
+    EspTask get_return_object();
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception();
+  };
+
+  typedef std::coroutine_handle<promise_type> Handle;
+
+  EspTask(EspTask &&other) noexcept;
+  EspTask(const EspTask &) = delete;
+  EspTask &operator=(const EspTask &) = delete;
+  ~EspTask();
+
+private:
+  friend class EspScheduler;
+  explicit EspTask(Handle handle);
+  Handle _handle;
+};
+
+/**
+ * Runs coroutines of several modules on a single thread. Each round polls
+ * every attached module once and resumes the coroutines whose command has
+ * finished or whose channel has received data.
+ */
+class EspScheduler
+{
+public:
+  /**
+   * Adds a module that is polled by each round.
+   * @param esp The module. It must outlive the scheduler.
+   */
+  template <class T>
+  void attach(Esp8266<T> &esp);
+
+  /**
+   * Takes over a coroutine. It first runs during the next round.
+   * @param task The coroutine, e.g. the result of calling an EspTask function.
+   */
+  void spawn(EspTask &&task);
+
+  /**
+   * Polls every module once and resumes the coroutines that can continue.
+   * Never blocks, so it can be called from the event loop of the application.
+   *
+   * @return Returns "true" while coroutines are left, "false" otherwise.
+   */
+  bool runOnce();
+
+  /**
+   * Calls runOnce() until every coroutine has finished.
+   */
+  void run();
+
+  /**
+   * Returns the count of coroutines that have not finished yet.
+   */
+  size_t size() const;
+
+private:
+  template <class T> friend class EspCoroutine;
+
+  typedef struct {
+    void *esp;
+    void (*poll)(void *esp);
+  } Module;
+
+  typedef struct {
+    std::coroutine_handle<> handle;
+    bool (*ready)(void *awaiter);     ///< Latches the result into the awaiter
+    void *awaiter;
+  } Waiter;
+
+  std::vector<Module> _modules;
+  std::vector<EspTask::Handle> _tasks;
+  std::vector<std::coroutine_handle<>> _runnable;
+  std::vector<Waiter> _waiters;
+
+  void wait(std::coroutine_handle<> handle, bool (*ready)(void *awaiter), void *awaiter);
+  void reap();
+};
+
+/**
+ * Awaitable operations on an Esp8266 module. Each operation queues the
+ * command of the matching *Async() method and suspends the coroutine until
+ * poll() finished it; no method ever blocks. The blocking methods of the
+ * module must not be used in a coroutine, they would stall every other one.
+ *
+ * @code
+ * EspTask fetch(EspCoroutine<HardwareSerial> &esp)
+ * {
+ *   if (!co_await esp.connect(1, "example.com", 80))
+ *     co_return;
+ *   co_await esp.send(1, request, length);
+ *   char buffer[64];
+ *   while (unsigned length = co_await esp.receive(1, buffer, sizeof(buffer)))
+ *     ...
+ * }
+ * @endcode
+ */
+template <class T>
+class EspCoroutine
+{
+public:
+  typedef typename Esp8266<T>::CommandId CommandId;
+  typedef typename Esp8266<T>::CommandStatus CommandStatus;
+  typedef typename Esp8266<T>::ProtocolMode ProtocolMode;
+
+  /**
+   * Suspends until a command has finished, returns "true" if it succeeded.
+   * A command that finds the queue full is submitted again each round until
+   * a slot is free; it only fails right away if it does not fit into the
+   * empty queue.
+   */
+  class CommandAwaiter
+  {
+  public:
+    CommandAwaiter(Esp8266<T> &esp, CommandId id);
+    CommandAwaiter(Esp8266<T> &esp, std::function<CommandId()> submit);
+    bool await_ready();
+    void await_suspend(EspTask::Handle handle);
+    bool await_resume() const;
+
+    /// The status the command finished with, e.g. TIMED_OUT.
+    CommandStatus status() const;
+
+  private:
+    Esp8266<T> &_esp;
+    std::function<CommandId()> _submit;   ///< Queues the command, empty for command()
+    CommandId _id;                        ///< 0 while the command is not queued
+    CommandStatus _status;
+    static bool ready(void *awaiter);
+  };
+
+  /// Suspends until data was received or the link was closed, returns the count of read bytes.
+  class ReceiveAwaiter
+  {
+  public:
+    ReceiveAwaiter(Esp8266<T> &esp, unsigned char channelId, char *buffer, unsigned length);
+    bool await_ready();
+    void await_suspend(EspTask::Handle handle);
+    unsigned await_resume();
+
+  private:
+    Esp8266<T> &_esp;
+    unsigned char _channelId;
+    char *_buffer;
+    unsigned _length;
+    static bool ready(void *awaiter);
+  };
+
+  /**
+   * Constructs the awaitable operations of a module.
+   * @param esp The module. Attach it to the scheduler that runs the coroutines.
+   */
+  explicit EspCoroutine(Esp8266<T> &esp);
+
+  /**
+   * Returns the module, e.g. for its non-blocking methods.
+   */
+  Esp8266<T> &module();
+
+  /**
+   * Awaits any command of the module.
+   * @param id The id returned by one of the *Async() methods. The id 0 of a
+   *        command that was not queued resumes with FAILED right away.
+   */
+  CommandAwaiter command(CommandId id);
+
+  /**
+   * Awaitable version of Esp8266::connect().
+   */
+  CommandAwaiter connect(unsigned char channelId, const String &addr, unsigned int port, ProtocolMode mode = Esp8266<T>::TCP);
+
+  /**
+   * Awaitable version of Esp8266::disconnect().
+   */
+  CommandAwaiter disconnect(unsigned char channelId);
+
+  /**
+   * Awaitable version of Esp8266::send().
+   * @note The buffer must stay valid until the coroutine is resumed.
+   */
+  CommandAwaiter send(unsigned char channelId, const char *bytes, size_t length);
+
+  /**
+   * Reads received bytes of a channel, waiting for them if necessary.
+   *
+   * @param channelId The channel to read from.
+   * @param buffer The buffer to be filled.
+   * @param length The size of the buffer.
+   * @return The count of copied bytes, 0 once the link is closed and no data is left.
+   */
+  ReceiveAwaiter receive(unsigned char channelId, char *buffer, unsigned length);
+
+private:
+  Esp8266<T> &_esp;
+};
+
+// Provide template definition
+#include <utility/EspCoroutine.cpp>
+
+#endif // __cplusplus >= 202002L
+
+#endif // __ESPCOROUTINE_H__
@@ -38,6 +38,14 @@
 class IPDParser
 {
 public:
+  static const unsigned int CHANNEL_COUNT = 5;   ///< Link ids 0..4 of the module
+
+  /// Counters of the payloads of a channel, named like Esp8266::ReceiveCounters
+  typedef struct {
+    unsigned overruns;            ///< Payloads that ended before their declared length
+    unsigned long lostBytes;      ///< Payload bytes missing from these payloads
+  } ReceiveCounters;
+
   IPDParser (Stream &stream);
 
   /**
@@ -80,10 +88,28 @@ public:
    * @param buffer The buffer to be filled with a stream of payload bytes.
    * @param bufferSize The size of the buffer. This is also the maximum amount
    * that can be read from the stream.
+   * @note If the stream times out before the payload is complete, or the
+   * header of the next "+IPD" message shows up within it, the bytes of the
+   * stream were overrun. The rest of the payload is counted as lost and
+   * dropped, so the next parse() finds the following header. Up to 6 bytes
+   * that may start such a header are held back until the next byte arrives.
    * @return The amount of copied bytes into the buffer.
    */
   unsigned int readPayload(char *buffer, unsigned int bufferSize);
 
+  /**
+   * Returns the counters of the payloads of a channel.
+   *
+   * @param channelId The channel to check.
+   * @return The counters since the construction or the last clearReceiveCounters().
+   */
+  ReceiveCounters getReceiveCounters(unsigned int channelId) const;
+
+  /**
+   * Resets the receive counters of all channels.
+   */
+  void clearReceiveCounters();
+
   /**
    *  Returns the payload as string
    *
@@ -102,11 +128,16 @@ private:
   Stream &_stream;
   unsigned int _channelId;
   unsigned int _payloadLength;
+  unsigned char _matched;         ///< Characters of a header found at the end of the payload so far
+  unsigned char _matchStart;      ///< 2 if that header has no line break in front
+  bool _headerFound;              ///< The next header up to its channel id ended the payload
+  ReceiveCounters _receiveCounters[CHANNEL_COUNT];
 
   // Terminal Symbols
   bool payload();
   bool channel();
   bool header();
+  bool headerFields();
   bool isJunk();
 
   // Non-Terminal Symbols
@@ -115,6 +146,10 @@ private:
   bool accept(const char s);
   bool expect(const char s);
   void nextsym();
+
+  // Overruns
+  unsigned int releaseMatch(char *buffer, unsigned int bufferSize);
+  void abortPayload(unsigned long lost);
 };
 
 #endif // __IPDPARSER_H__
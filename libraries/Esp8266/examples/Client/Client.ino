@@ -0,0 +1,40 @@
+#include <Esp8266.h>
+#include <EspClient.h>
+#include <SoftwareSerial.h>
+
+SoftwareSerial mySerial(2,3);
+Esp8266<SoftwareSerial> esp(mySerial);
+EspClient<SoftwareSerial> client(esp, 1);
+
+void setup()
+{
+  Serial.begin(9600);
+
+  // Wait for serial interface of the Aruino Leonardo and Micro.
+  while(!Serial)
+    ;
+
+  Serial.print(F("Detecting the WiFi module ...\n"));
+  esp.configureBaud();
+  esp.setMultipleConnections(true);
+
+  if (!esp.joinAccessPoint(F("MyNetwork"), F("MyPassword")) || !client.connect("example.com", 80)) {
+    Serial.print(F("  could not connect.\n"));
+    return;
+  }
+
+  // The lines are collected and sent with a single AT+CIPSEND by flush().
+  client.print(F("GET / HTTP/1.1\r\n"));
+  client.print(F("Host: example.com\r\n"));
+  client.print(F("Connection: close\r\n\r\n"));
+  client.flush();
+}
+
+void loop()
+{
+  while (client.available())
+    Serial.write(client.read());
+
+  if (!client.connected())
+    client.stop();
+}
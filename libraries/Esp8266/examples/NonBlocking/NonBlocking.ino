@@ -0,0 +1,38 @@
+#include <Esp8266.h>
+#include <SoftwareSerial.h>
+
+SoftwareSerial mySerial(2,3);
+Esp8266<SoftwareSerial> esp(mySerial);
+
+unsigned long lastCheck = 0;
+
+// Called by poll() as soon as the module answered.
+void commandFinished(Esp8266<SoftwareSerial>::CommandId id, Esp8266<SoftwareSerial>::CommandStatus status)
+{
+  if (status == Esp8266<SoftwareSerial>::SUCCEEDED)
+    Serial.print(F("  the module answers.\n"));
+  else
+    Serial.print(F("  the module does not answer.\n"));
+}
+
+void setup()
+{
+  Serial.begin(9600);
+
+  // Wait for serial interface of the Aruino Leonardo and Micro.
+  while(!Serial)
+    ;
+
+  Serial.print(F("Detecting the WiFi module ...\n"));
+  esp.configureBaud();
+  esp.setCommandCallback(commandFinished);
+}
+
+void loop()
+{
+  // Submit a new check every five seconds, the loop keeps running meanwhile.
+  if (millis() - lastCheck > 5000 && esp.isOkAsync())
+    lastCheck = millis();
+
+  esp.poll();
+}
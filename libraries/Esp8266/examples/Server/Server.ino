@@ -0,0 +1,42 @@
+#include <Esp8266.h>
+#include <SoftwareSerial.h>
+
+SoftwareSerial mySerial(2,3);
+Esp8266<SoftwareSerial> esp(mySerial);
+
+void setup()
+{
+  Serial.begin(9600);
+
+  // Wait for serial interface of the Aruino Leonardo and Micro.
+  while(!Serial)
+    ;
+
+  Serial.print(F("Detecting the WiFi module ...\n"));
+  esp.configureBaud();
+
+  if (!esp.joinAccessPoint(F("MyNetwork"), F("MyPassword")) || !esp.startServer(5000)) {
+    Serial.print(F("  could not start the server.\n"));
+    return;
+  }
+
+  // Close clients that stay silent for a minute.
+  esp.setServerTimeout(60);
+}
+
+void loop()
+{
+  unsigned char channel = esp.accept();
+  if (channel != Esp8266<SoftwareSerial>::NO_LINK) {
+    Serial.print(F("Client on channel "));
+    Serial.println(channel);
+  }
+
+  // Answer each request of a client with its own bytes.
+  for (unsigned char i = 0; i < ESP8266_CHANNEL_COUNT; i++) {
+    char buffer[32];
+    unsigned length = esp.read(i, buffer, sizeof(buffer));
+    if (length)
+      esp.send(i, buffer, length);
+  }
+}
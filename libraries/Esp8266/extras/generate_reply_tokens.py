@@ -0,0 +1,123 @@
+#!/usr/bin/env python
+"""
+Generates utility/ReplyTokens.h, the automaton of the ReplyMatcher.
+
+Every reply line of the module starts with one of the tokens below. The
+tokens are compiled into a trie whose states are stored in PROGMEM, so the
+matcher consumes each received byte once, however many tokens are watched.
+A '#' in a token matches one decimal digit.
+
+Add a token to TOKENS and run this script from the library folder:
+
+    python extras/generate_reply_tokens.py > utility/ReplyTokens.h
+"""
+
+import sys
+
+# (name, text, prefix): a prefix token is recognized as soon as its text was
+# received, the rest of the line are its arguments. Other tokens must match
+# the whole line.
+TOKENS = [
+    ("PROMPT",            ">",                 True),
+    ("OK",                "OK",                False),
+    ("SEND_OK",           "SEND OK",           False),
+    ("ERROR",             "ERROR",             False),
+    ("FAIL",              "FAIL",              False),
+    ("SEND_FAIL",         "SEND FAIL",         False),
+    ("ALREADY_CONNECTED", "ALREADY CONNECTED", False),
+    ("BUSY",              "busy ",             True),
+    ("CONNECT",           "CONNECT",           False),
+    ("CLOSED",            "CLOSED",            False),
+    ("LINK_CONNECT",      "#,CONNECT",         False),
+    ("LINK_CLOSED",       "#,CLOSED",          False),
+    ("WIFI_CONNECTED",    "WIFI CONNECTED",    False),
+    ("WIFI_GOT_IP",       "WIFI GOT IP",       False),
+    ("WIFI_DISCONNECT",   "WIFI DISCONNECT",   False),
+    ("READY",             "ready",             False),
+    ("DATA",              "+IPD,",             True),
+    ("CIPMUX",            "+CIPMUX:",          True),
+    ("CIPDOMAIN",         "+CIPDOMAIN:",       True),
+    ("CWJAP_CUR",         "+CWJAP_CUR:",       True),
+    ("CIPSTATUS",         "+CIPSTATUS:",       True),
+]
+
+LICENSE = open(__file__.replace("extras/generate_reply_tokens.py", "utility/SerialTraits.h")).read()
+LICENSE = LICENSE[:LICENSE.index(" */") + 4]
+
+
+def symbols(text):
+    for c in text:
+        if c == "#":
+            for digit in "0123456789":
+                yield digit
+        else:
+            yield c
+
+
+def build():
+    # A state is [edges, token, prefix], edges map a character to a state
+    states = [[{}, 0, False]]
+    for number, (name, text, prefix) in enumerate(TOKENS, 1):
+        current = [0]
+        for c in text:
+            chars = "0123456789" if c == "#" else c
+            following = []
+            for state in current:
+                for char in chars:
+                    edges = states[state][0]
+                    if char not in edges:
+                        # The digits of '#' share one state
+                        if following and char != chars[0]:
+                            edges[char] = following[-1]
+                            continue
+                        states.append([{}, 0, False])
+                        edges[char] = len(states) - 1
+                    if edges[char] not in following:
+                        following.append(edges[char])
+            current = following
+        for state in current:
+            if states[state][1]:
+                sys.exit("token %s collides with another token" % name)
+            if prefix and states[state][0]:
+                sys.exit("prefix token %s is the start of another token" % name)
+            states[state][1] = number
+            states[state][2] = prefix
+    return states
+
+
+def main():
+    states = build()
+    edges = []
+    rows = []
+    for edge_map, token, prefix in states:
+        rows.append((len(edges), len(edge_map), token, prefix))
+        edges.extend(sorted(edge_map.items()))
+    if len(states) >= 255 or len(edges) > 255:
+        sys.exit("the automaton does not fit into unsigned char indices")
+
+    out = sys.stdout
+    out.write(LICENSE.replace("@brief Capabilities of the serial interface the module is connected to.",
+                              "@brief Reply tokens of the module, generated by extras/generate_reply_tokens.py.") + "\n")
+    out.write("// Generated by extras/generate_reply_tokens.py, do not edit.\n\n")
+    out.write("#ifndef __REPLY_TOKENS_H__\n#define __REPLY_TOKENS_H__\n\n")
+    out.write("#include <Arduino.h>\n\n")
+    out.write("typedef enum {\n  TOKEN_NONE,\n")
+    for name, text, prefix in TOKENS:
+        out.write("  TOKEN_%s,%s///< %s\"%s\"\n" % (name, " " * (20 - len(name)), "Prefix " if prefix else "", text))
+    out.write("} ReplyToken;\n\n")
+    out.write("static const unsigned char REPLY_STATE_COUNT = %d;\n\n" % len(states))
+    out.write("// Per state: first edge, edge count, token and 1 for a prefix token\n")
+    out.write("static const unsigned char REPLY_STATES[][4] PROGMEM = {\n")
+    for number, row in enumerate(rows):
+        out.write("  { %3d, %2d, %2d, %d },  // %d\n" % (row[0], row[1], row[2], int(row[3]), number))
+    out.write("};\n\n")
+    out.write("// Per edge: character and next state, sorted by character per state\n")
+    out.write("static const unsigned char REPLY_EDGES[][2] PROGMEM = {\n")
+    for char, state in edges:
+        out.write("  { '%s', %3d },\n" % ("\\'" if char == "'" else char, state))
+    out.write("};\n\n")
+    out.write("#endif // __REPLY_TOKENS_H__\n")
+
+
+if __name__ == "__main__":
+    main()
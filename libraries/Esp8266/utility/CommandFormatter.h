@@ -0,0 +1,230 @@
+/**
+ *  @file
+ *  @brief Formatter for AT commands without heap allocations.
+ *  @author Joern Hoffmann <jhoffmann@informatik.uni-leipzig.de>
+ *  @author Joern Hoffmann <j.hoffmann@xceeth.com>
+ *  @version 1.0
+ *
+ *  @section LICENSE
+ *
+ *  The MIT License (MIT)
+ *  Copyright (c) 2015 Joern Hoffmann
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __COMMAND_FORMATTER_H__
+#define __COMMAND_FORMATTER_H__
+
+#include <Arduino.h>
+#include <Print.h>
+#include <utility/RingBuffer.h>
+
+// -------------------------------------------------------------------------- //
+// Parameters
+// -------------------------------------------------------------------------- //
+/// Marks a parameter that is enclosed in quotes, e.g. "ssid".
+template <typename Type>
+struct QuotedParameter
+{
+  const Type &value;
+};
+
+template <typename Type>
+static inline QuotedParameter<Type> quote(const Type &value)
+{
+  QuotedParameter<Type> parameter = { value };
+  return parameter;
+}
+
+/// Marks an IPv4 address that is printed as dotted quad, lowest byte first.
+struct AddressParameter
+{
+  unsigned long value;
+};
+
+static inline AddressParameter dottedQuad(unsigned long value)
+{
+  AddressParameter parameter = { value };
+  return parameter;
+}
+
+/// Marks a MAC address of 6 bytes that is printed as aa:bb:cc:dd:ee:ff.
+struct MacParameter
+{
+  const unsigned char *bytes;
+};
+
+static inline MacParameter macAddress(const unsigned char *bytes)
+{
+  MacParameter parameter = { bytes };
+  return parameter;
+}
+
+static inline void printParameter(Print &out, const String &param)
+{
+  out.print(param);
+}
+
+static inline void printParameter(Print &out, const __FlashStringHelper *param)
+{
+  out.print(param);
+}
+
+static inline void printParameter(Print &out, const char *param)
+{
+  out.print(param);
+}
+
+// Integers are printed as decimal numbers, never as characters
+static inline void printParameter(Print &out, unsigned long param)
+{
+  out.print(param);
+}
+
+static inline void printParameter(Print &out, long param)
+{
+  out.print(param);
+}
+
+static inline void printParameter(Print &out, unsigned int param)
+{
+  out.print((unsigned long)param);
+}
+
+static inline void printParameter(Print &out, int param)
+{
+  out.print((long)param);
+}
+
+static inline void printParameter(Print &out, unsigned char param)
+{
+  out.print((unsigned long)param);
+}
+
+static inline void printParameter(Print &out, bool param)
+{
+  out.print(param ? '1' : '0');
+}
+
+static inline void printParameter(Print &out, const AddressParameter &param)
+{
+  for (unsigned char i = 0; i < 4; i++) {
+    if (i)
+      out.print('.');
+    out.print((param.value >> (8 * i)) & 0xFF);
+  }
+}
+
+static inline void printParameter(Print &out, const MacParameter &param)
+{
+  static const char DIGITS[] = "0123456789abcdef";
+  for (unsigned char i = 0; i < 6; i++) {
+    if (i)
+      out.print(':');
+    out.print(DIGITS[param.bytes[i] >> 4]);
+    out.print(DIGITS[param.bytes[i] & 0x0F]);
+  }
+}
+
+template <typename Type>
+static inline void printParameter(Print &out, const QuotedParameter<Type> &param)
+{
+  out.print('"');
+  printParameter(out, param.value);
+  out.print('"');
+}
+
+static inline void printParameterList(Print &)
+{ }
+
+template <typename Type, typename ... Types>
+static inline void printParameterList(Print &out, const Type &param, const Types &...rest)
+{
+  printParameter(out, param);
+  if (sizeof...(rest))
+    out.print(',');
+
+  printParameterList(out, rest...);
+}
+
+// -------------------------------------------------------------------------- //
+// Commands
+// -------------------------------------------------------------------------- //
+/**
+ * Prints a set command, e.g. AT+CIPSEND=1,42 without the tailing line feed.
+ *
+ * @param out The serial or buffer to print to.
+ * @param command The name of the command after "AT+" (program memory).
+ * @param parameters The comma separated parameters. Wrap strings with quote()
+ * to enclose them in quotes.
+ */
+template <typename ... Types>
+static void printSetCommand(Print &out, const __FlashStringHelper *command, const Types &...parameters)
+{
+  out.print(F("AT+"));
+  out.print(command);
+  out.print('=');
+  printParameterList(out, parameters...);
+}
+
+/**
+ * Appends printed characters to a ring buffer. Characters that do not fit
+ * are dropped and marked as overflow.
+ */
+template <unsigned SIZE>
+class RingBufferWriter : public Print
+{
+public:
+  RingBufferWriter(RingBuffer<SIZE> &buffer) : _buffer(buffer), _written(0), _overflow(false)
+  { }
+
+  size_t write(uint8_t c)
+  {
+    if (!_buffer.push(c)) {
+      _overflow = true;
+      return 0;
+    }
+
+    _written++;
+    return 1;
+  }
+
+  using Print::write;
+
+  /// The count of appended characters
+  unsigned written() const
+  {
+    return _written;
+  }
+
+  /// True if at least one character was dropped
+  bool overflow() const
+  {
+    return _overflow;
+  }
+
+private:
+  RingBuffer<SIZE> &_buffer;
+  unsigned _written;
+  bool _overflow;
+};
+
+#endif
@@ -32,104 +32,197 @@
 #ifdef __ESP8266_H__
 #include <utility/TimeHelper.h>
 
-#define BAUD_MIN 2400
-#define BAUD_MAX 115200
-
 // -------------------------------------------------------------------------- //
-// String Helpers
+// Reply parsing
 // -------------------------------------------------------------------------- //
-static const String substringFromBeginUntilOccurenceOfString(const String &string, const String &untilString)
-{
-  int index = string.indexOf(untilString);
-  if (index == -1 || index == 0 || string.length() == 0)
-    return String();
+// Replies that are read directly from the serial, bypassing the ReplyMatcher
+static const char REPLY_OK[] PROGMEM = "OK";
+static const char REPLY_ERROR[] PROGMEM = "ERROR";
 
-  return string.substring(0, index-1);
-}
+// Start of an "+IPD" message within the payload of an overrun one, the line
+// break in front of it is optional
+static const char IPD_HEADER[] PROGMEM = "\r\n+IPD,";
+static const unsigned char IPD_HEADER_LENGTH = sizeof(IPD_HEADER) - 1;
+
+// Echoed by testLink(), printable characters with alternating bit patterns
+static const char LINK_TEST_PATTERN[] PROGMEM = "AT+LINKTEST=U*U*~!~!0123456789aZ";
 
-static const String substringAfterOccurenceOfStringToEnd(const String &string, const String &fromString)
+/**
+ * Parses an unsigned decimal number of a line in place.
+ *
+ * @param line The buffered line.
+ * @param position The position of the first digit. Points behind the number afterwards.
+ * @param value The parsed value.
+ * @return True if at least one digit was parsed.
+ */
+template <unsigned SIZE>
+static bool parseUnsigned(const RingBuffer<SIZE> &line, unsigned &position, unsigned long &value)
 {
-  int index = string.indexOf(fromString);
-  if (index == -1 || string.length() == 0 || fromString.length() == 0)
-    return String();
+  unsigned first = position;
 
-  return string.substring(index+1);
-}
+  value = 0;
+  while (position < line.size()) {
+    char c = line.peek(position);
+    if (c < '0' || c > '9')
+      break;
 
-static const String getAnswerSubstring(const String &string)
-{
-  String answer = substringFromBeginUntilOccurenceOfString(string, "\r\nOK\r\n");
-  answer = substringAfterOccurenceOfStringToEnd(answer, ":");
+    value = value * 10 + (c - '0');
+    position++;
+  }
 
-  return answer;
+  return position != first;
 }
 
-static const String buildParameterList(const String &param)
+// -------------------------------------------------------------------------- //
+// Computational helpers
+// -------------------------------------------------------------------------- //
+// Supported baud rates, ordered by the likelihood of being set on the module
+static const unsigned long BAUD_RATES[] PROGMEM = {
+  115200, 9600, 57600, 19200, 38400, 4800, 2400
+};
+static const unsigned BAUD_RATE_COUNT = sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]);
+
+// Rates above 115200, ascending; they depend on the capabilities of the host
+static const unsigned long HIGH_BAUD_RATES[] PROGMEM = {
+  230400, 460800, 921600
+};
+static const unsigned HIGH_BAUD_RATE_COUNT = sizeof(HIGH_BAUD_RATES) / sizeof(HIGH_BAUD_RATES[0]);
+
+static unsigned long baudRate(unsigned index)
 {
-  return param;
+  return pgm_read_dword(&BAUD_RATES[index]);
 }
 
-static const String buildParameterList(int param)
+static unsigned long highBaudRate(unsigned index)
 {
-  return String(param);
+  return pgm_read_dword(&HIGH_BAUD_RATES[index]);
 }
 
-template<typename ... Types>
-static const String buildParameterList(const String &param, const Types &...rest)
+static bool isBaudRateSupported(unsigned long baud)
 {
-  return param + F(",") + buildParameterList(rest...);
+  for (unsigned i = 0; i < BAUD_RATE_COUNT; i++) {
+    if (baud == baudRate(i))
+      return true;
+  }
+
+  for (unsigned i = 0; i < HIGH_BAUD_RATE_COUNT; i++) {
+    if (baud == highBaudRate(i))
+      return true;
+  }
+
+  return false;
 }
 
-static const String quoteString(const String &string)
+// 32 bit FNV-1a hash, identifies hosts and access points without storing their names
+static const unsigned long HASH_OFFSET = 2166136261UL;
+
+static unsigned long hashCharacter(unsigned long hash, unsigned char c)
 {
-  static const String quote(F("\""));
-  return String(quote + string + quote);
+  return ((hash ^ c) * 16777619UL) & 0xFFFFFFFFUL;
 }
 
-template <typename ... Types>
-static const String buildSetCommand(const String &command, const Types &...parameters)
+static unsigned long hashString(const String &text)
 {
-  String prefix(F("AT+"));
-  prefix += command;
-  prefix += F("=");
-  return prefix + buildParameterList(parameters...);
+  unsigned long hash = HASH_OFFSET;
+  for (unsigned i = 0; i < text.length(); i++)
+    hash = hashCharacter(hash, text[i]);
+
+  return hash;
 }
 
-// -------------------------------------------------------------------------- //
-// Computational helpers
-// -------------------------------------------------------------------------- //
-static unsigned long nextBaud(unsigned long baud)
+// 32 bit sdbm hash, computed independently of hashString() to detect its collisions
+static unsigned long checkString(const String &text)
 {
-  if (baud == 38400)
-    baud = 57600;
-  else
-    baud *= 2;
+  unsigned long hash = 0;
+  for (unsigned i = 0; i < text.length(); i++)
+    hash = ((unsigned char)text[i] + (hash << 6) + (hash << 16) - hash) & 0xFFFFFFFFUL;
 
-  if (baud > BAUD_MAX)
-    baud = BAUD_MAX;
+  return hash;
+}
 
-  return baud;
+// Value of a hexadecimal digit or -1
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+
+  return -1;
 }
 
-static bool isBaudRateSupported(unsigned long baud)
+/**
+ * Parses a dotted-quad IPv4 address, e.g. "192.168.4.1".
+ *
+ * @param address The parsed address, the first octet is the lowest byte.
+ * @return True if the whole text is an address.
+ */
+static bool parseAddress(const char *text, unsigned long &address)
 {
-  unsigned long baudCompare = BAUD_MIN;
-  while (baudCompare <= BAUD_MAX)
-  {
-    if (baud == baudCompare)
-      return true;
+  address = 0;
+  for (unsigned char octet = 0; octet < 4; octet++) {
+    if (octet && *text++ != '.')
+      return false;
+
+    unsigned value = 0;
+    unsigned char digits = 0;
+    while (*text >= '0' && *text <= '9' && digits < 3) {
+      value = value * 10 + (*text++ - '0');
+      digits++;
+    }
+
+    if (!digits || value > 255)
+      return false;
+
+    address |= (unsigned long)value << (8 * octet);
+  }
 
-    baudCompare = nextBaud(baudCompare);
-  };
+  return *text == '\0';
+}
 
-  return false;
+// Characters of a reply at the correct baud rate
+static bool isReplyCharacter(char c)
+{
+  return (c >= ' ' && c <= '~') || c == '\r' || c == '\n';
 }
 
 // -------------------------------------------------------------------------- //
 // Public
 // -------------------------------------------------------------------------- //
 template <class T>
-Esp8266<T>::Esp8266(T &serial) : _serial(serial) {
+Esp8266<T>::Esp8266(T &serial) : _serial(serial), _baud(0), _flowControl(false),
+  _status(IDLE), _failure(FAILED), _lastStatus(IDLE), _callback(NULL), _deadline(0),
+  _payloadPending(false), _packetLength(0), _passthrough(false), _moduleState(0),
+  _serverPort(0), _firstCommand(0), _commandCount(0), _lastId(0),
+  _dataHandler(NULL), _ipdChannel(0), _ipdRemaining(0), _ipdDeadline(0), _ipdMatched(0),
+  _ipdMatchStart(0), _connectedLinks(0),
+  _acceptedLinks(0), _closedLinks(0), _datagramCount(0), _datagramLinks(0),
+  _ipdDatagram(false), _joinDuration(0)
+{
+  for (unsigned i = 0; i < EVENT_COUNT; i++)
+    _eventHandlers[i] = NULL;
+
+  for (unsigned i = 0; i < ESP8266_COMMAND_QUEUE_SIZE; i++) {
+    _results[i].id = 0;
+    _results[i].status = IDLE;
+  }
+
+  for (unsigned i = 0; i < ESP8266_CHANNEL_COUNT; i++) {
+    _pool[i].port = 0;
+    _remotes[i].address = 0;
+  }
+
+  clearReceiveCounters();
+
+  _accessPoint.channel = 0;
+
+#ifdef ESP8266_DNS_CACHE_SIZE
+  for (unsigned i = 0; i < ESP8266_DNS_CACHE_SIZE; i++)
+    _dnsCache[i].address = 0;
+#endif
+
   setTimeout(DEFAULT_TIMEOUT);
 };
 
@@ -140,274 +233,2250 @@ T& Esp8266<T>::getSerial() const
 }
 
 template <class T>
-bool Esp8266<T>::isOk() const
+bool Esp8266<T>::isOk()
 {
-  sendCommand(F("AT"));
-  return wasCommandSuccessful();
+  return wasCommandSuccessful(isOkAsync());
 }
 
 template <class T>
-unsigned long Esp8266<T>::configureBaud() const
+unsigned long Esp8266<T>::configureBaud()
 {
-  unsigned long baud = BAUD_MIN;
-  while (baud <= BAUD_MAX)
-  {
-    // Set new rate to stream
-    _serial.begin(baud);
+  if (isBusy())
+    return 0;
+
+#ifdef ESP8266_BAUD_EEPROM_ADDRESS
+  if (!_baud)
+    EEPROM.get(ESP8266_BAUD_EEPROM_ADDRESS, _baud);
+#endif
+
+  // The last working rate is the most likely one
+  unsigned long lastBaud = _baud;
+  if (isBaudRateSupported(lastBaud) && probeBaud(lastBaud))
+    return rememberBaud(lastBaud);
+
+  for (unsigned i = 0; i < BAUD_RATE_COUNT; i++) {
+    unsigned long baud = baudRate(i);
+    if (baud != lastBaud && probeBaud(baud))
+      return rememberBaud(baud);
+  }
 
-    // Check module reply, if it answers correctly return rate.
-    if (isOk())
-      return baud;
+  for (unsigned i = 0; i < HIGH_BAUD_RATE_COUNT; i++) {
+    unsigned long baud = highBaudRate(i);
+    if (baud > SerialTraits<T>::MAX_BAUD)
+      break;
 
-    // Continue
-    baud = nextBaud(baud);
+    if (baud != lastBaud && probeBaud(baud))
+      return rememberBaud(baud);
   }
 
+  _baud = 0;
   return 0;
 }
 
 template <class T>
-bool Esp8266<T>::setBaud(unsigned long baud) const
+unsigned long Esp8266<T>::getBaud() const
+{
+  return _baud;
+}
+
+template <class T>
+bool Esp8266<T>::setBaud(unsigned long baud, bool flowControl)
 {
-  if (!isBaudRateSupported(baud))
+  if (!isBaudRateSupported(baud) || baud > SerialTraits<T>::MAX_BAUD || isBusy() || (flowControl && !SerialFlowControl<T>::SUPPORTED))
     return false;
 
+  if ((_moduleState & STATE_BAUD) && baud == _baud && flowControl == _flowControl)
+    return true;
+
   // Send command
-  String cmd = buildSetCommand(F("UART_CUR"), String(baud), F("8"), F("1"), F("0"), F("0"));
-  sendCommand(cmd);
+  sendSetCommand(F("UART_CUR"), baud, 8, 1, 0, flowControl ? 3 : 0);
 
   // Change baud, send some stuff and delete possible wrong characters
-  _serial.begin(baud);
+  beginSerial(baud, flowControl);
+  isOk();
   isOk();
+  flushIn();
+
+  if (isOk()) {
+    _flowControl = flowControl;
+    rememberBaud(baud);
+    return true;
+  }
+
+  if (!flowControl)
+    return false;
+
+  // The module only waits for CTS, so it still receives commands if the
+  // lines are not wired. Keep the new rate without flow control then.
+  sendSetCommand(F("UART_CUR"), baud, 8, 1, 0, 0);
+  beginSerial(baud, false);
   isOk();
   flushIn();
 
-  return isOk();
+  _flowControl = false;
+  if (isOk())
+    rememberBaud(baud);
+
+  return false;
 }
 
 template <class T>
-bool Esp8266<T>::setMultipleConnections(bool enable)
+bool Esp8266<T>::isFlowControlEnabled() const
+{
+  return _flowControl;
+}
+
+template <class T>
+unsigned long Esp8266<T>::negotiateBaud(unsigned long maxBaud)
+{
+  if (!_baud && !configureBaud())
+    return 0;
+
+  for (unsigned i = 0; i < HIGH_BAUD_RATE_COUNT; i++) {
+    unsigned long baud = highBaudRate(i);
+    if (baud > maxBaud)
+      break;
+
+    if (baud <= _baud)
+      continue;
+
+    unsigned long cleanBaud = _baud;
+    if (setBaud(baud, _flowControl) && testLink() == 0)
+      continue;
+
+    restoreBaud(cleanBaud);
+    break;
+  }
+
+  return _baud;
+}
+
+template <class T>
+unsigned long Esp8266<T>::testLink(unsigned rounds)
 {
-  String cmd = buildSetCommand(F("CIPMUX"), enable);
-  sendCommand(cmd);
+  const unsigned length = strlen_P(LINK_TEST_PATTERN);
+  unsigned long errors = 0;
+
+  // The test relies on the echo of the module
+  Command *echo = changesState(queueCommand(F("ATE1")), STATE_ECHO_KNOWN | STATE_ECHO_ENABLED, STATE_ECHO_KNOWN | STATE_ECHO_ENABLED);
+  if (!wasCommandSuccessful(submit(echo)))
+    return (unsigned long)rounds * length;
+
+  for (unsigned round = 0; round < rounds; round++) {
+    flushIn();
+    _line.clear();
+    _serial.print(reinterpret_cast<const __FlashStringHelper *>(LINK_TEST_PATTERN));
+    _serial.print(F("\r\n"));
+    flushOut();
+
+    // Compare the echo byte by byte, missing bytes are errors too
+    unsigned received = 0;
+    unsigned long until = millis() + DEFAULT_TIMEOUT;
+    while (received < length && isFuture(until)) {
+      if (!_serial.available())
+        continue;
+
+      if (_serial.read() != pgm_read_byte(LINK_TEST_PATTERN + received))
+        errors++;
+      received++;
+    }
+    errors += length - received;
+
+    // The module rejects the unknown command
+    if (!awaitRawLine(REPLY_ERROR, DEFAULT_TIMEOUT))
+      errors++;
+  }
+
+  return errors;
+}
 
-  return wasCommandSuccessful();
+template <class T>
+bool Esp8266<T>::setMultipleConnections(bool enable)
+{
+  return wasCommandSuccessful(setMultipleConnectionsAsync(enable));
 }
 
 template <class T>
-bool Esp8266<T>::getMultipleConnections(bool &multipleConnections) const
+bool Esp8266<T>::getMultipleConnections(bool &multipleConnections)
 {
-  sendCommand(F("AT+CIPMUX?"));
+  // The mode is known if it was set or queried before
+  if (_moduleState & STATE_MULTIPLE_KNOWN) {
+    multipleConnections = _moduleState & STATE_MULTIPLE_ENABLED;
+    return true;
+  }
+
+  Command *command = queueCommand(F("AT+CIPMUX?"));
+  if (!command)
+    return false;
 
-  // Get answer
-  String reply = readReply();
-  String answer = getAnswerSubstring(reply);
-  if (answer.length() == 0)
+  // The value is parsed from the reply line as soon as it arrives
+  command->query = QUERY_MULTIPLE_CONNECTIONS;
+  CommandId id = submit(command);
+  if (!wasCommandSuccessful(id) || !resultOf(id).answered)
     return false;
 
-  // "Parse" answer
-  // Todo: add checks if we have a value
-  multipleConnections = answer.toInt();
+  multipleConnections = resultOf(id).value;
+  _moduleState |= STATE_MULTIPLE_KNOWN;
+  if (multipleConnections)
+    _moduleState |= STATE_MULTIPLE_ENABLED;
   return true;
 }
 
 template <class T>
-bool Esp8266<T>::joinAccessPoint(const String &ssid, const String &passwd) const
+bool Esp8266<T>::resolve(const String &host, unsigned long &address)
 {
-  // put module into client mode
-  sendCommand(F("AT+CWMODE_CUR=1"));
+  // Addresses need no lookup
+  if (parseAddress(host.c_str(), address))
+    return true;
+
+#ifdef ESP8266_DNS_CACHE_SIZE
+  if (findCachedAddress(host, address))
+    return true;
+#endif
 
-  if (!wasCommandSuccessful())
+  Command *command = queueSetCommand(MEDIUM_TIMEOUT, F("CIPDOMAIN"), quote(host));
+  if (!command)
     return false;
 
-  String cmd = buildSetCommand(F("CWJAP_CUR"), quoteString(ssid), quoteString(passwd));
-  sendCommand(cmd);
+  command->query = QUERY_DOMAIN;
+  CommandId id = submit(command);
+  if (!wasCommandSuccessful(id) || !resultOf(id).answered)
+    return false;
 
-  return wasCommandSuccessful(LONG_TIMEOUT);
+  address = resultOf(id).value;
+#ifdef ESP8266_DNS_CACHE_SIZE
+  cacheAddress(host, address);
+#endif
+  return true;
 }
 
 template <class T>
-bool Esp8266<T>::connect(unsigned channelId, const String &addr, unsigned port, ProtocolMode mode) const
+bool Esp8266<T>::joinAccessPoint(const String &ssid, const String &passwd)
 {
-  String modeString;
+  return wasCommandSuccessful(joinAccessPointAsync(ssid, passwd));
+}
 
-  switch (mode) {
-    case UDP:
-      modeString = F("UDP");
-      break;
-    case TCP:
-      modeString = F("TCP");
-      break;
-    case TLS:
-      modeString = F("SSL");
-      // init ssl buffer on the module
-      sendCommand(F("AT+CIPSSLSIZE=4096"));
-      if (!wasCommandSuccessful())
-        return false;
-      break;
-  }
+template <class T>
+typename Esp8266<T>::JoinMode Esp8266<T>::rejoinAccessPoint(const String &ssid, const String &passwd)
+{
+  unsigned long start = millis();
+  unsigned long ssidHash = hashString(ssid);
+  JoinMode mode = JOIN_FAILED;
+
+#ifdef ESP8266_JOIN_EEPROM_ADDRESS
+  if (!isKnownAccessPoint())
+    EEPROM.get(ESP8266_JOIN_EEPROM_ADDRESS, _accessPoint);
+#endif
+
+  // The query below replaces the known access point
+  bool known = isKnownAccessPoint() && _accessPoint.ssidHash == ssidHash;
+  unsigned char bssid[6];
+  memcpy(bssid, _accessPoint.bssid, sizeof(bssid));
+
+  if (queryAccessPoint() && _accessPoint.ssidHash == ssidHash)
+    mode = JOIN_KEPT;
+  else if (known && wasCommandSuccessful(queueJoin(ssid, passwd, bssid)))
+    mode = JOIN_FAST;
+  else if (joinAccessPoint(ssid, passwd))
+    mode = JOIN_FULL;
+
+  // Remember the access point for the next time
+  if ((mode == JOIN_FAST || mode == JOIN_FULL) && queryAccessPoint())
+    rememberAccessPoint();
+
+  _joinDuration = millis() - start;
+  return mode;
+}
+
+template <class T>
+unsigned long Esp8266<T>::getJoinDuration() const
+{
+  return _joinDuration;
+}
 
-  String cmd = buildSetCommand(F("CIPSTART"), String(channelId), quoteString(modeString), quoteString(addr), port);
+template <class T>
+bool Esp8266<T>::setAutoConnect(bool enable)
+{
+  return wasCommandSuccessful(setAutoConnectAsync(enable));
+}
 
-  sendCommand(cmd);
+template <class T>
+bool Esp8266<T>::connect(unsigned channelId, const String &addr, unsigned port, ProtocolMode mode)
+{
+#ifdef ESP8266_DNS_CACHE_SIZE
+  // Resolve once, so connectAsync() finds the address in the cache
+  unsigned long address;
+  resolve(addr, address);
+#endif
 
-  return wasCommandSuccessful(MEDIUM_TIMEOUT);
+  return wasCommandSuccessful(connectAsync(channelId, addr, port, mode));
 }
 
 template <class T>
-bool Esp8266<T>::connectSecure(unsigned channelId, const String &addr) const
+bool Esp8266<T>::connectSecure(unsigned channelId, const String &addr)
 {
   return connect(channelId, addr, 443, TLS);
 }
 
 template <class T>
-bool Esp8266<T>::disconnect(unsigned channelId) const
+bool Esp8266<T>::disconnect(unsigned channelId)
 {
-  String cmd = buildSetCommand(F("CIPCLOSE"), channelId);
-  sendCommand(cmd);
+  return wasCommandSuccessful(disconnectAsync(channelId));
+}
 
-  return wasCommandSuccessful(MEDIUM_TIMEOUT);
+template <class T>
+bool Esp8266<T>::send(unsigned char channelId, const char *bytes, const unsigned length)
+{
+  return wasCommandSuccessful(sendAsync(channelId, bytes, length));
 }
 
 template <class T>
-bool Esp8266<T>::send(unsigned char channelId, const char *bytes, const unsigned length) const
+bool Esp8266<T>::send(unsigned char channelId, const __FlashStringHelper *string)
 {
-  String cmd = buildSetCommand(F("CIPSEND"), String(channelId), length);
-  sendCommand(cmd);
+  return wasCommandSuccessful(sendAsync(channelId, string));
+}
 
-  // Is module ready to get data?
-  if (!wasCommandSuccessful())
-    return false;
+template <class T>
+bool Esp8266<T>::send_P(unsigned char channelId, PGM_P bytes, size_t length)
+{
+  return wasCommandSuccessful(sendAsync_P(channelId, bytes, length));
+}
 
-  // Write data
-  _serial.write(bytes, length);
-  flushOut();
+template <class T>
+bool Esp8266<T>::send(unsigned char channelId, const Segment *segments, unsigned char count)
+{
+  return wasCommandSuccessful(sendAsync(channelId, segments, count));
+}
+
+template <class T>
+size_t Esp8266<T>::write(unsigned char channelId, const char *bytes, size_t length)
+{
+  CommandId id = sendAsync(channelId, bytes, length);
+  wasCommandSuccessful(id);
 
-  return wasCommandSuccessful();
+  return getDeliveredBytes(id);
 }
 
 template <class T>
-bool Esp8266<T>::send(unsigned char channelId, const String &string) const
+bool Esp8266<T>::send(unsigned char channelId, const String &string)
 {
   return send(channelId, string.c_str(), string.length());
 }
 
+template <class T>
+bool Esp8266<T>::openDatagram(unsigned char channelId, const String &addr, unsigned remotePort, unsigned localPort)
+{
+  return wasCommandSuccessful(openDatagramAsync(channelId, addr, remotePort, localPort));
+}
 
-// -------------------------------------------------------------------------- //
-// Private
-// -------------------------------------------------------------------------- //
-// -------------------------------------------------------------------------- //
-// Serial
-// -------------------------------------------------------------------------- //
-/**
- * Sets the timeout to read strings from the input stream
- */
 template <class T>
-void Esp8266<T>::setTimeout(unsigned timeout) const
+bool Esp8266<T>::sendDatagram(unsigned char channelId, const char *bytes, size_t length, const String &addr, unsigned port)
 {
-  _serial.setTimeout(timeout);
+  return wasCommandSuccessful(sendDatagramAsync(channelId, bytes, length, addr, port));
 }
 
-/**
- * Cleans the output stream.
- */
 template <class T>
-void Esp8266<T>::flushOut() const
+bool Esp8266<T>::sendDatagram(unsigned char channelId, const char *bytes, size_t length, unsigned long address, unsigned port)
 {
-  _serial.flush();
+  return wasCommandSuccessful(sendDatagramAsync(channelId, bytes, length, address, port));
 }
 
-/**
- * Clean the input stream
- */
 template <class T>
-void Esp8266<T>::flushIn() const
+bool Esp8266<T>::setRemoteInfo(bool enable)
 {
-  // Read all characters
-  while (_serial.available()) {
-    _serial.read();
+  return wasCommandSuccessful(setRemoteInfoAsync(enable));
+}
+
+template <class T>
+bool Esp8266<T>::startServer(unsigned port)
+{
+  return wasCommandSuccessful(startServerAsync(port));
+}
+
+template <class T>
+bool Esp8266<T>::stopServer()
+{
+  return wasCommandSuccessful(stopServerAsync());
+}
+
+template <class T>
+bool Esp8266<T>::setServerTimeout(unsigned seconds)
+{
+  return wasCommandSuccessful(setServerTimeoutAsync(seconds));
+}
+
+template <class T>
+unsigned char Esp8266<T>::accept()
+{
+  poll();
+
+  for (unsigned char i = 0; i < ESP8266_CHANNEL_COUNT; i++) {
+    if (_acceptedLinks & (1 << i)) {
+      _acceptedLinks &= ~(1 << i);
+      return i;
+    }
   }
+
+  return NO_LINK;
 }
 
-/**
- * Cleans the input and output buffer of the stream.
- */
 template <class T>
-void Esp8266<T>::flush() const
+typename Esp8266<T>::LinkState Esp8266<T>::getLinkState(unsigned char channelId) const
 {
-  flushOut();
-  flushIn();
+  if (isConnected(channelId))
+    return LINK_UP;
+
+  return isOpening(channelId) ? LINK_OPENING : LINK_DOWN;
 }
 
-// -------------------------------------------------------------------------- //
-// Commands
-// -------------------------------------------------------------------------- //
-/**
- * Reads the reply of an AT-command.
- *
- * @param timout The maximum time to wait to fill the reply string.
- * return The string representation of the reply.
- */
 template <class T>
-const String Esp8266<T>::readReply(unsigned long timeout) const
+typename Esp8266<T>::ReceiveCounters Esp8266<T>::getReceiveCounters(unsigned char channelId) const
 {
-  // TODO: reimplement with finer timeout control.
-  if (timeout == DEFAULT_TIMEOUT)
-    return _serial.readString();
+  if (channelId >= ESP8266_CHANNEL_COUNT) {
+    ReceiveCounters none = { 0, 0, 0 };
+    return none;
+  }
 
-  setTimeout(timeout);
-  String retString = _serial.readString();
-  setTimeout(DEFAULT_TIMEOUT);
-  return retString;
+  return _receiveCounters[channelId];
 }
 
-/**
- * Scans the stream for the given AT answer.
- *
- * @note The method doesn't create a string. It just reacts on the terminal
- * substring '\r\n' of an AT command and scans the string before it.
- *
- * @parameter answer The answer to search befor the
- * @paramter timeout The absolute timeout to wait for the answer.
- * @return True if the answer string was found in the reply, false otherwise.
- */
 template <class T>
-bool Esp8266<T>::findAnswer(char *answer, unsigned long timeout) const
+void Esp8266<T>::clearReceiveCounters()
 {
-  unsigned long until = millis() + timeout;
+  for (unsigned i = 0; i < ESP8266_CHANNEL_COUNT; i++) {
+    _receiveCounters[i].overruns = 0;
+    _receiveCounters[i].lostBytes = 0;
+    _receiveCounters[i].droppedBytes = 0;
+  }
+}
 
-  // Read until answer was parsed or timout occurs.
-  do {
-    if (_serial.findUntil(answer, "\r\n"))
-      return true;
-  } while (millis() <= until);
+template <class T>
+bool Esp8266<T>::syncLinks()
+{
+  return wasCommandSuccessful(syncLinksAsync());
+}
 
-  return false;
+template <class T>
+bool Esp8266<T>::getRemote(unsigned char channelId, unsigned long &address, unsigned &port) const
+{
+  if (channelId >= ESP8266_CHANNEL_COUNT || !_remotes[channelId].address)
+    return false;
+
+  address = _remotes[channelId].address;
+  port = _remotes[channelId].port;
+  return true;
 }
 
-/**
- * Checks if the answer of an AT-command was "OK".
- *
- * @param timout The maximum time to wait for the answer.
- * @return Returns "true" if the AT command was successful.
- */
- template <class T>
- bool Esp8266<T>::wasCommandSuccessful(unsigned long timeout) const
- {
-   return findAnswer("OK", timeout);
- }
+template <class T>
+unsigned Esp8266<T>::readDatagram(unsigned char channelId, char *buffer, unsigned length, unsigned long &address, unsigned &port)
+{
+  for (unsigned char i = 0; i < _datagramCount; i++) {
+    if (_datagrams[i].channelId != channelId)
+      continue;
+
+    // The first datagram of the channel is still arriving
+    if (isReceiving(i))
+      return 0;
+
+    Datagram datagram = _datagrams[i];
+    removeDatagram(i);
+
+    address = datagram.sender.address;
+    port = datagram.sender.port;
+    if (!buffer)
+      length = 0;
+    else if (length > datagram.length)
+      length = datagram.length;
+
+    _receiveBuffers[channelId].read(buffer, length);
+    _receiveBuffers[channelId].discard(datagram.length - length);
+    return length;
+  }
+
+  return 0;
+}
 
-/// Sends an command with the tailing line feed of AT-commands
 template <class T>
-void Esp8266<T>::sendCommand(const String &command) const
+bool Esp8266<T>::beginPassthrough(const String &addr, unsigned port, ProtocolMode mode)
 {
-  flushIn();
-  _serial.print(command);
-  _serial.print(F("\r\n"));
-  flushOut();
+  // The transparent transmission is only supported for a single connection
+  if (_passthrough || !setMultipleConnections(false))
+    return false;
+
+  if (mode == TLS && !wasCommandSuccessful(submit(changesState(queueCommand(F("AT+CIPSSLSIZE=4096")), STATE_SSL_SIZE, STATE_SSL_SIZE))))
+    return false;
+
+  if (!wasCommandSuccessful(submit(queueSetCommand(MEDIUM_TIMEOUT, F("CIPSTART"), quote(protocolName(mode)), quote(addr), port))))
+    return false;
+
+  if (!wasCommandSuccessful(submit(queueSetCommand(DEFAULT_TIMEOUT, F("CIPMODE"), 1))))
+    return false;
+
+  // The prompt of AT+CIPSEND starts the transmission
+  Command *command = queueCommand(F("AT+CIPSEND"));
+  if (!command)
+    return false;
+
+  command->passthrough = true;
+  return wasCommandSuccessful(submit(command));
 }
 
-#undef BAUD_MIN
-#undef BAUD_MAX
+template <class T>
+bool Esp8266<T>::endPassthrough()
+{
+  if (!_passthrough)
+    return false;
+
+  // "+++" is only recognized as a packet of its own
+  flushOut();
+  delay(PASSTHROUGH_GUARD_TIME);
+  _serial.print(F("+++"));
+  flushOut();
+  delay(PASSTHROUGH_GUARD_TIME + PASSTHROUGH_EXIT_TIME);
+
+  // Data of the link that arrived meanwhile is no reply
+  flushIn();
+  _passthrough = false;
+
+  Command *mode = queueSetCommand(DEFAULT_TIMEOUT, F("CIPMODE"), 0);
+  Command *close = mode ? queueCommand(F("AT+CIPCLOSE")) : NULL;
+  if (!close) {
+    if (mode)
+      unqueueCommand();
+    issueCommand();
+    return false;
+  }
+
+  close->chained = true;
+  return wasCommandSuccessful(submit(close));
+}
+
+template <class T>
+bool Esp8266<T>::isPassthrough() const
+{
+  return _passthrough;
+}
+
+template <class T>
+unsigned Esp8266<T>::available(unsigned char channelId) const
+{
+  if (channelId >= ESP8266_CHANNEL_COUNT)
+    return 0;
+
+  return _receiveBuffers[channelId].size();
+}
+
+template <class T>
+unsigned Esp8266<T>::read(unsigned char channelId, char *buffer, unsigned length)
+{
+  if (channelId >= ESP8266_CHANNEL_COUNT || !buffer)
+    return 0;
+
+  length = _receiveBuffers[channelId].read(buffer, length);
+  consumeDatagrams(channelId, length);
+  return length;
+}
+
+template <class T>
+int Esp8266<T>::read(unsigned char channelId)
+{
+  if (channelId >= ESP8266_CHANNEL_COUNT)
+    return -1;
+
+  consumeDatagrams(channelId, 1);
+  return _receiveBuffers[channelId].pop();
+}
+
+template <class T>
+int Esp8266<T>::peek(unsigned char channelId) const
+{
+  if (channelId >= ESP8266_CHANNEL_COUNT || _receiveBuffers[channelId].isEmpty())
+    return -1;
+
+  return (unsigned char)_receiveBuffers[channelId].peek(0);
+}
+
+template <class T>
+bool Esp8266<T>::isConnected(unsigned char channelId) const
+{
+  return channelId < ESP8266_CHANNEL_COUNT && (_connectedLinks & (1 << channelId));
+}
+
+template <class T>
+unsigned char Esp8266<T>::openLink(const String &addr, unsigned port, ProtocolMode mode)
+{
+  // Process pending "CLOSED" messages first
+  poll();
+
+  unsigned char channelId = findPooledLink(addr, port, mode);
+  if (channelId == NO_LINK) {
+    channelId = allocateLink();
+    if (channelId == NO_LINK || !connect(channelId, addr, port, mode))
+      return NO_LINK;
+
+    PooledLink &link = _pool[channelId];
+    link.hostHash = hashString(addr);
+    link.hostCheck = checkString(addr);
+    link.port = port;
+    link.mode = mode;
+  }
+
+  _pool[channelId].lastUse = millis();
+  return channelId;
+}
+
+// -------------------------------------------------------------------------- //
+// Asynchronous interface
+// -------------------------------------------------------------------------- //
+template <class T>
+typename Esp8266<T>::CommandStatus Esp8266<T>::poll()
+{
+  // The input belongs to the application during the transparent transmission
+  if (_passthrough)
+    return _status;
+
+  while (!_passthrough && _serial.available()) {
+    if (_ipdRemaining)
+      receiveData();
+    else
+      parseReply(_serial.read());
+  }
+
+  // The rest of an overrun message was lost, the next byte starts a new line
+  if (_ipdRemaining && !isFuture(_ipdDeadline)) {
+    char held[IPD_HEADER_LENGTH];
+    deliverData(held, releaseMatch(held));
+    abortData(_ipdRemaining);
+  }
+
+  if (_status == PENDING && !isFuture(_deadline))
+    finishCommand(TIMED_OUT);
+
+  return _status;
+}
+
+template <class T>
+typename Esp8266<T>::CommandStatus Esp8266<T>::getCommandStatus() const
+{
+  return _status;
+}
+
+template <class T>
+typename Esp8266<T>::CommandStatus Esp8266<T>::getLastStatus() const
+{
+  return _lastStatus;
+}
+
+template <class T>
+typename Esp8266<T>::CommandStatus Esp8266<T>::getCommandStatus(CommandId id) const
+{
+  const Result &result = _results[id % ESP8266_COMMAND_QUEUE_SIZE];
+  if (!id || result.id != id)
+    return IDLE;
+
+  return result.status;
+}
+
+template <class T>
+size_t Esp8266<T>::getDeliveredBytes(CommandId id) const
+{
+  const Result &result = _results[id % ESP8266_COMMAND_QUEUE_SIZE];
+  if (!id || result.id != id)
+    return 0;
+
+  return result.value;
+}
+
+template <class T>
+bool Esp8266<T>::isBusy() const
+{
+  return _commandCount != 0;
+}
+
+template <class T>
+void Esp8266<T>::setCommandCallback(CommandCallback callback)
+{
+  _callback = callback;
+}
+
+template <class T>
+void Esp8266<T>::setEventHandler(Event event, EventHandler handler)
+{
+  if (event < EVENT_COUNT)
+    _eventHandlers[event] = handler;
+}
+
+template <class T>
+void Esp8266<T>::setDataHandler(DataHandler handler)
+{
+  _dataHandler = handler;
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::isOkAsync()
+{
+  return submit(queueCommand(F("AT")));
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::setMultipleConnectionsAsync(bool enable)
+{
+  unsigned char mode = STATE_MULTIPLE_KNOWN | (enable ? STATE_MULTIPLE_ENABLED : 0);
+  return submit(changesState(queueSetCommand(DEFAULT_TIMEOUT, F("CIPMUX"), enable), STATE_MULTIPLE_KNOWN | STATE_MULTIPLE_ENABLED, mode));
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::joinAccessPointAsync(const String &ssid, const String &passwd)
+{
+  return queueJoin(ssid, passwd, NULL);
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::setAutoConnectAsync(bool enable)
+{
+  return submit(queueSetCommand(DEFAULT_TIMEOUT, F("CWAUTOCONN"), enable));
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::connectAsync(unsigned channelId, const String &addr, unsigned port, ProtocolMode mode)
+{
+  // init ssl buffer on the module first
+  Command *sslSize = NULL;
+  if (mode == TLS && !(sslSize = changesState(queueCommand(F("AT+CIPSSLSIZE=4096")), STATE_SSL_SIZE, STATE_SSL_SIZE)))
+    return 0;
+
+  Command *command = NULL;
+#ifdef ESP8266_DNS_CACHE_SIZE
+  // Connecting by address spares the lookup of the module
+  unsigned long cached;
+  if (findCachedAddress(addr, cached))
+    command = queueSetCommand(MEDIUM_TIMEOUT, F("CIPSTART"), channelId, quote(protocolName(mode)), quote(dottedQuad(cached)), port);
+  else
+#endif
+    command = queueSetCommand(MEDIUM_TIMEOUT, F("CIPSTART"), channelId, quote(protocolName(mode)), quote(addr), port);
+
+  if (!command) {
+    if (sslSize)
+      unqueueCommand();
+    return 0;
+  }
+
+  // Data left over from a previous connection is stale
+  if (channelId < ESP8266_CHANNEL_COUNT) {
+    _receiveBuffers[channelId].clear();
+    _datagramLinks &= ~(1 << channelId);
+    forgetDatagrams(channelId);
+    unsigned long address;
+    _remotes[channelId].address = parseAddress(addr.c_str(), address) ? address : 0;
+    _remotes[channelId].port = port;
+  }
+
+  command->channelId = channelId;
+  command->opensLink = true;
+  command->chained = (sslSize != NULL);
+  return submit(command);
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::disconnectAsync(unsigned channelId)
+{
+  return submit(queueSetCommand(MEDIUM_TIMEOUT, F("CIPCLOSE"), channelId));
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::sendAsync(unsigned char channelId, const char *bytes, size_t length)
+{
+  return queueSend(channelId, bytes, length, false);
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::sendAsync(unsigned char channelId, const __FlashStringHelper *string)
+{
+  PGM_P bytes = reinterpret_cast<PGM_P>(string);
+  return queueSend(channelId, bytes, bytes ? strlen_P(bytes) : 0, true);
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::sendAsync_P(unsigned char channelId, PGM_P bytes, size_t length)
+{
+  return queueSend(channelId, bytes, length, true);
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::sendAsync(unsigned char channelId, const Segment *segments, unsigned char count)
+{
+  size_t length = 0;
+  for (unsigned char i = 0; i < count; i++)
+    length += segments[i].length;
+
+  if (!length || !canQueue(1))
+    return 0;
+
+  Command *command = queueCommand(F(""));
+  command->channelId = channelId;
+  command->segments = segments;
+  command->segmentCount = count;
+  command->payloadLength = length;
+  return submit(command);
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::openDatagramAsync(unsigned char channelId, const String &addr, unsigned remotePort, unsigned localPort)
+{
+  // Mode 2: the remote may change with every AT+CIPSEND
+  Command *command = queueSetCommand(MEDIUM_TIMEOUT, F("CIPSTART"), channelId, quote(protocolName(UDP)), quote(addr), remotePort, localPort, 2);
+  if (!command)
+    return 0;
+
+  if (channelId < ESP8266_CHANNEL_COUNT) {
+    _receiveBuffers[channelId].clear();
+    _remotes[channelId].address = 0;
+    _datagramLinks |= 1 << channelId;
+    forgetDatagrams(channelId);
+  }
+
+  command->channelId = channelId;
+  command->opensLink = true;
+  return submit(command);
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::startServerAsync(unsigned port)
+{
+  // The server requires the multiple connection mode
+  unsigned char mode = STATE_MULTIPLE_KNOWN | STATE_MULTIPLE_ENABLED;
+  if (!changesState(queueSetCommand(DEFAULT_TIMEOUT, F("CIPMUX"), true), mode, mode))
+    return 0;
+
+  // The state only tells that a server runs, a different port needs a restart
+  unsigned char queued = 1;
+  if (_serverPort && _serverPort != port) {
+    Command *stop = changesState(queueSetCommand(DEFAULT_TIMEOUT, F("CIPSERVER"), 0), STATE_SERVER, 0);
+    if (!stop) {
+      unqueueCommand();
+      return 0;
+    }
+
+    stop->chained = true;
+    queued++;
+  }
+
+  Command *command = changesState(queueSetCommand(DEFAULT_TIMEOUT, F("CIPSERVER"), 1, port), STATE_SERVER, STATE_SERVER);
+  if (!command) {
+    while (queued--)
+      unqueueCommand();
+    return 0;
+  }
+
+  _serverPort = port;
+  command->chained = true;
+  return submit(command);
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::stopServerAsync()
+{
+  _serverPort = 0;
+  return submit(changesState(queueSetCommand(DEFAULT_TIMEOUT, F("CIPSERVER"), 0), STATE_SERVER, 0));
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::setServerTimeoutAsync(unsigned seconds)
+{
+  return submit(queueSetCommand(DEFAULT_TIMEOUT, F("CIPSTO"), seconds));
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::syncLinksAsync()
+{
+  Command *command = queueCommand(F("AT+CIPSTATUS"));
+  if (!command)
+    return 0;
+
+  command->query = QUERY_LINK_STATUS;
+  return submit(command);
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::sendDatagramAsync(unsigned char channelId, const char *bytes, size_t length, const String &addr, unsigned port)
+{
+  return queueDatagram(channelId, bytes, length, addr, port);
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::sendDatagramAsync(unsigned char channelId, const char *bytes, size_t length, unsigned long address, unsigned port)
+{
+  return queueDatagram(channelId, bytes, length, dottedQuad(address), port);
+}
+
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::setRemoteInfoAsync(bool enable)
+{
+  return submit(queueSetCommand(DEFAULT_TIMEOUT, F("CIPDINFO"), enable));
+}
+
+// -------------------------------------------------------------------------- //
+// Private
+// -------------------------------------------------------------------------- //
+// -------------------------------------------------------------------------- //
+// Serial
+// -------------------------------------------------------------------------- //
+/**
+ * Sets the timeout to read strings from the input stream
+ */
+template <class T>
+void Esp8266<T>::setTimeout(unsigned timeout) const
+{
+  _serial.setTimeout(timeout);
+}
+
+/**
+ * Cleans the output stream.
+ */
+template <class T>
+void Esp8266<T>::flushOut() const
+{
+  _serial.flush();
+}
+
+/**
+ * Clean the input stream
+ */
+template <class T>
+void Esp8266<T>::flushIn() const
+{
+  // Read all characters
+  while (_serial.available()) {
+    _serial.read();
+  }
+}
+
+/**
+ * Cleans the input and output buffer of the stream.
+ */
+template <class T>
+void Esp8266<T>::flush() const
+{
+  flushOut();
+  flushIn();
+}
+
+// -------------------------------------------------------------------------- //
+// Commands
+// -------------------------------------------------------------------------- //
+/**
+ * Waits until a queued command has finished.
+ *
+ * @param id The id of the command, 0 if it could not be queued.
+ * @return Returns "true" if the AT command was successful.
+ */
+template <class T>
+bool Esp8266<T>::wasCommandSuccessful(CommandId id)
+{
+  // Queued commands wait for the end of the transparent transmission
+  while (getCommandStatus(id) == PENDING && !_passthrough)
+    poll();
+
+  _lastStatus = getCommandStatus(id);
+  return _lastStatus == SUCCEEDED;
+}
+
+/**
+ * Checks if the given count of commands fit into the queue.
+ */
+template <class T>
+bool Esp8266<T>::canQueue(unsigned count) const
+{
+  return _commandCount + count <= ESP8266_COMMAND_QUEUE_SIZE;
+}
+
+/**
+ * Appends a command without parameters to the queue. The command is not sent
+ * before submit().
+ *
+ * @param command The complete command, e.g. F("AT").
+ * @param timeout The maximum time to wait for the reply once the command was sent.
+ * @return The queued command to adjust or NULL if the queue is full.
+ */
+template <class T>
+typename Esp8266<T>::Command *Esp8266<T>::queueCommand(const __FlashStringHelper *command, unsigned long timeout)
+{
+  if (!canQueue(1))
+    return NULL;
+
+  RingBufferWriter<ESP8266_COMMAND_BUFFER_SIZE> writer(_commandBuffer);
+  writer.print(command);
+  return appendCommand(writer, timeout);
+}
+
+/**
+ * Appends a set command to the queue. The command is formatted directly into
+ * the command buffer. It is not sent before submit().
+ *
+ * @param timeout The maximum time to wait for the reply once the command was sent.
+ * @param command The name of the command after "AT+", e.g. F("CIPMUX").
+ * @return The queued command to adjust or NULL if the queue is full.
+ */
+template <class T>
+template <typename ... Types>
+typename Esp8266<T>::Command *Esp8266<T>::queueSetCommand(unsigned long timeout, const __FlashStringHelper *command, const Types &...parameters)
+{
+  if (!canQueue(1))
+    return NULL;
+
+  RingBufferWriter<ESP8266_COMMAND_BUFFER_SIZE> writer(_commandBuffer);
+  printSetCommand(writer, command, parameters...);
+  return appendCommand(writer, timeout);
+}
+
+/**
+ * Adds the queue entry of the characters that were just written to the
+ * command buffer.
+ *
+ * @return The queued command or NULL if the characters did not fit.
+ */
+template <class T>
+typename Esp8266<T>::Command *Esp8266<T>::appendCommand(const RingBufferWriter<ESP8266_COMMAND_BUFFER_SIZE> &writer, unsigned long timeout)
+{
+  if (writer.overflow()) {
+    _commandBuffer.truncate(_commandBuffer.size() - writer.written());
+    return NULL;
+  }
+
+  // Ids are never 0. They wrap after the last id before a multiple of the
+  // queue size, so consecutive ids use consecutive result slots for any size.
+  const CommandId maxId = (CommandId)~0U;
+  if (_lastId == maxId - (maxId % ESP8266_COMMAND_QUEUE_SIZE + 1) % ESP8266_COMMAND_QUEUE_SIZE)
+    _lastId = ESP8266_COMMAND_QUEUE_SIZE;
+  else
+    _lastId++;
+
+  unsigned char index = (_firstCommand + _commandCount++) % ESP8266_COMMAND_QUEUE_SIZE;
+  Command *command = &_commands[index];
+  command->id = _lastId;
+  command->length = writer.written();
+  command->timeout = timeout;
+  command->query = NO_QUERY;
+  command->chained = false;
+  command->stateMask = 0;
+  command->stateValue = 0;
+  command->passthrough = false;
+  command->channelId = 0;
+  command->opensLink = false;
+  command->segments = NULL;
+  command->segmentCount = 0;
+  command->payloadLength = 0;
+  command->delivered = 0;
+
+  Result &result = resultOf(_lastId);
+  result.id = _lastId;
+  result.status = PENDING;
+  result.answered = false;
+  result.value = 0;
+
+  return command;
+}
+
+/**
+ * Removes the last queued command that was not submitted yet.
+ */
+template <class T>
+void Esp8266<T>::unqueueCommand()
+{
+  unsigned char index = (_firstCommand + _commandCount - 1) % ESP8266_COMMAND_QUEUE_SIZE;
+  Command &command = _commands[index];
+
+  _commandBuffer.truncate(_commandBuffer.size() - command.length);
+  resultOf(command.id).status = IDLE;
+  _commandCount--;
+}
+
+/**
+ * Sends the next queued command if the module is idle.
+ *
+ * @return The id of the given command or 0 for NULL.
+ */
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::submit(const Command *command)
+{
+  if (!command)
+    return 0;
+
+  CommandId id = command->id;
+  issueCommand();
+  return id;
+}
+
+/**
+ * Marks a queued command as one that changes settings of the module. It
+ * succeeds without being sent if the settings already have these values.
+ *
+ * @param mask The settings of ModuleState the command changes.
+ * @param value Their values after the command.
+ * @return The given command, NULL if the command is NULL.
+ */
+template <class T>
+typename Esp8266<T>::Command *Esp8266<T>::changesState(Command *command, unsigned char mask, unsigned char value)
+{
+  if (command) {
+    command->stateMask = mask;
+    command->stateValue = value;
+  }
+
+  return command;
+}
+
+/**
+ * Sends the first queued command, unless it was already sent. The text is
+ * ready in the command buffer, so this happens right after the reply of the
+ * previous command.
+ */
+template <class T>
+void Esp8266<T>::issueCommand()
+{
+  while (_status != PENDING && !_passthrough && _commandCount) {
+    Command &command = currentCommand();
+
+    // Dependent commands of a failed command are finished with the same status
+    if (command.chained && _status != SUCCEEDED && _status != IDLE) {
+      _commandBuffer.discard(command.length);
+      dequeueCommand(_status);
+      continue;
+    }
+
+    // Settings are checked when the command is due, a reset may have happened meanwhile
+    if (command.stateMask && (_moduleState & command.stateMask) == command.stateValue) {
+      _commandBuffer.discard(command.length);
+      _status = SUCCEEDED;
+      dequeueCommand(SUCCEEDED);
+      continue;
+    }
+
+    // Data for a link that is known to be closed would only time out
+    if (command.segments && (_closedLinks & (1 << command.channelId))) {
+      _commandBuffer.discard(command.length);
+      _status = NOT_CONNECTED;
+      dequeueCommand(NOT_CONNECTED);
+      continue;
+    }
+
+    _status = PENDING;
+    _failure = FAILED;
+
+    if (command.segments && !command.length) {
+      issuePacket(command);
+      continue;
+    }
+
+    for (unsigned i = 0; i < command.length; i++)
+      _serial.write(_commandBuffer.pop());
+
+    _serial.print(F("\r\n"));
+    flushOut();
+
+    // A datagram is announced by the text of the command and sent in one packet
+    if (command.segments) {
+      _payloadPending = true;
+      _packetLength = command.payloadLength;
+    }
+
+    _deadline = millis() + command.timeout;
+  }
+}
+
+/**
+ * Announces the next packet of a send command with AT+CIPSEND. The packet
+ * is written as soon as the module shows its prompt.
+ */
+template <class T>
+void Esp8266<T>::issuePacket(Command &command)
+{
+  size_t remaining = command.payloadLength - command.delivered;
+
+  _payloadPending = true;
+  _packetLength = remaining < MAX_SEND_SIZE ? remaining : MAX_SEND_SIZE;
+  _deadline = millis() + command.timeout;
+
+  sendSetCommand(F("CIPSEND"), command.channelId, _packetLength);
+}
+
+/**
+ * Queues a send command with a single buffer in RAM or flash memory.
+ *
+ * @return The id of the command or 0 if the queue is full.
+ */
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::queueSend(unsigned char channelId, const char *bytes, size_t length, bool progmem)
+{
+  if (!bytes || !length || !canQueue(1))
+    return 0;
+
+  // AT+CIPSEND is formatted per packet when the command is issued
+  return submit(attachPayload(queueCommand(F("")), channelId, bytes, length, progmem));
+}
+
+template <class T>
+template <typename Address>
+typename Esp8266<T>::CommandId Esp8266<T>::queueDatagram(unsigned char channelId, const char *bytes, size_t length, const Address &addr, unsigned port)
+{
+  // A datagram can not be split into packets
+  if (!bytes || !length || length > MAX_SEND_SIZE || !canQueue(1))
+    return 0;
+
+  // The remote is only known now, so AT+CIPSEND is queued as text
+  Command *command = queueSetCommand(DEFAULT_TIMEOUT, F("CIPSEND"), channelId, length, quote(addr), port);
+  if (!command)
+    return 0;
+
+  return submit(attachPayload(command, channelId, bytes, length, false));
+}
+
+template <class T>
+typename Esp8266<T>::Command *Esp8266<T>::attachPayload(Command *command, unsigned char channelId, const char *bytes, size_t length, bool progmem)
+{
+  command->channelId = channelId;
+  command->buffer.data = bytes;
+  command->buffer.length = length;
+  command->buffer.progmem = progmem;
+  command->segments = &command->buffer;
+  command->segmentCount = 1;
+  command->payloadLength = length;
+  return command;
+}
+
+/**
+ * Returns the open channel of the pool that is connected to the given server.
+ *
+ * @return The channel or NO_LINK if there is none.
+ */
+template <class T>
+unsigned char Esp8266<T>::findPooledLink(const String &host, unsigned port, ProtocolMode mode) const
+{
+  unsigned long hostHash = hashString(host);
+  unsigned long hostCheck = checkString(host);
+  for (unsigned char i = 0; i < ESP8266_CHANNEL_COUNT; i++) {
+    const PooledLink &link = _pool[i];
+    if (link.port == port && link.mode == mode && link.hostHash == hostHash && link.hostCheck == hostCheck && isConnected(i))
+      return i;
+  }
+
+  return NO_LINK;
+}
+
+/**
+ * Returns a channel for a new link of the pool. A channel without a link is
+ * preferred, otherwise the least recently used link of the pool is closed.
+ * Links opened with connect() are never closed.
+ *
+ * @return The channel or NO_LINK if all channels are in use.
+ */
+template <class T>
+unsigned char Esp8266<T>::allocateLink()
+{
+  unsigned char leastRecent = NO_LINK;
+  for (unsigned char i = 0; i < ESP8266_CHANNEL_COUNT; i++) {
+    if (!isConnected(i)) {
+      _pool[i].port = 0;
+      return i;
+    }
+
+    // The difference of the times is negative if i was used before, even if millis() wrapped
+    if (_pool[i].port && (leastRecent == NO_LINK || _pool[i].lastUse - _pool[leastRecent].lastUse > 0x7FFFFFFFUL))
+      leastRecent = i;
+  }
+
+  if (leastRecent != NO_LINK) {
+    disconnect(leastRecent);
+    _pool[leastRecent].port = 0;
+  }
+
+  return leastRecent;
+}
+
+#ifdef ESP8266_DNS_CACHE_SIZE
+/**
+ * Looks up the address of a host that was resolved before.
+ *
+ * @return True if the address was found and did not expire yet.
+ */
+template <class T>
+bool Esp8266<T>::findCachedAddress(const String &host, unsigned long &address) const
+{
+  unsigned long hostHash = hashString(host);
+  unsigned long hostCheck = checkString(host);
+  for (unsigned i = 0; i < ESP8266_DNS_CACHE_SIZE; i++) {
+    const CachedAddress &entry = _dnsCache[i];
+    if (entry.address && entry.hostHash == hostHash && entry.hostCheck == hostCheck && isFuture(entry.expiry)) {
+      address = entry.address;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Stores a resolved address. It replaces the entry of the same host, an
+ * unused or expired entry or the entry that expires first.
+ */
+template <class T>
+void Esp8266<T>::cacheAddress(const String &host, unsigned long address)
+{
+  unsigned long hostHash = hashString(host);
+  unsigned long hostCheck = checkString(host);
+  CachedAddress *target = &_dnsCache[0];
+  for (unsigned i = 0; i < ESP8266_DNS_CACHE_SIZE; i++) {
+    CachedAddress &entry = _dnsCache[i];
+    if ((entry.hostHash == hostHash && entry.hostCheck == hostCheck) || !entry.address || !isFuture(entry.expiry)) {
+      target = &entry;
+      break;
+    }
+
+    if (entry.expiry - target->expiry > 0x7FFFFFFFUL)
+      target = &entry;
+  }
+
+  target->hostHash = hostHash;
+  target->hostCheck = hostCheck;
+  target->address = address;
+  target->expiry = millis() + ESP8266_DNS_CACHE_TTL;
+}
+#endif
+
+/**
+ * Queues the commands to join an access point.
+ *
+ * @param bssid The MAC address of the access point or NULL to join any
+ *        access point with the ssid.
+ * @return The id of the last command or 0 if the queue is full.
+ */
+template <class T>
+typename Esp8266<T>::CommandId Esp8266<T>::queueJoin(const String &ssid, const String &passwd, const unsigned char *bssid)
+{
+  // put module into client mode, then join
+  Command *mode = changesState(queueCommand(F("AT+CWMODE_CUR=1")), STATE_STATION_MODE, STATE_STATION_MODE);
+  Command *join = NULL;
+  if (mode && bssid)
+    join = queueSetCommand(LONG_TIMEOUT, F("CWJAP_CUR"), quote(ssid), quote(passwd), quote(macAddress(bssid)));
+  else if (mode)
+    join = queueSetCommand(LONG_TIMEOUT, F("CWJAP_CUR"), quote(ssid), quote(passwd));
+
+  if (!join) {
+    if (mode)
+      unqueueCommand();
+    return 0;
+  }
+
+  join->chained = true;
+  return submit(join);
+}
+
+/**
+ * Queries the access point the module is associated with.
+ *
+ * @return True if the module is associated. The access point is stored in
+ *         _accessPoint then.
+ */
+template <class T>
+bool Esp8266<T>::queryAccessPoint()
+{
+  Command *command = queueCommand(F("AT+CWJAP_CUR?"));
+  if (!command)
+    return false;
+
+  command->query = QUERY_ACCESS_POINT;
+  CommandId id = submit(command);
+  return wasCommandSuccessful(id) && resultOf(id).answered;
+}
+
+/**
+ * Parses the access point of a "+CWJAP_CUR:" line into _accessPoint.
+ *
+ * @note Line := +CWJAP_CUR:"<ssid>","<bssid>",<channel>,<rssi>
+ * @param position The position behind the colon.
+ * @return True if the line was complete.
+ */
+template <class T>
+bool Esp8266<T>::parseAccessPoint(unsigned position)
+{
+  if (position >= _line.size() || _line.peek(position++) != '"')
+    return false;
+
+  unsigned long ssidHash = HASH_OFFSET;
+  while (position < _line.size() && _line.peek(position) != '"')
+    ssidHash = hashCharacter(ssidHash, _line.peek(position++));
+
+  // The rest of the line has a fixed layout up to the channel
+  if (position + 22 >= _line.size() || _line.peek(position + 1) != ',' || _line.peek(position + 2) != '"')
+    return false;
+
+  position += 3;
+  unsigned char bssid[6];
+  for (unsigned char i = 0; i < 6; i++, position += 3) {
+    int high = hexValue(_line.peek(position));
+    int low = hexValue(_line.peek(position + 1));
+    if (high < 0 || low < 0 || _line.peek(position + 2) != (i < 5 ? ':' : '"'))
+      return false;
+
+    bssid[i] = (high << 4) | low;
+  }
+
+  unsigned long channel;
+  if (_line.peek(position++) != ',' || !parseUnsigned(_line, position, channel))
+    return false;
+
+  _accessPoint.ssidHash = ssidHash;
+  memcpy(_accessPoint.bssid, bssid, sizeof(bssid));
+  _accessPoint.channel = channel;
+  return true;
+}
+
+/**
+ * Parses a "+CIPSTATUS:" line. The remote of the link is stored in _remotes.
+ *
+ * @note Line := +CIPSTATUS:<id>,"<type>","<address>",<port>,<local port>,<server>
+ * @param position The position behind the colon.
+ * @param links The bit of the link is set.
+ * @return True if the line was complete.
+ */
+template <class T>
+bool Esp8266<T>::parseLinkStatus(unsigned position, unsigned long &links)
+{
+  unsigned long channelId;
+  if (!parseUnsigned(_line, position, channelId) || channelId >= ESP8266_CHANNEL_COUNT)
+    return false;
+
+  // Skip the type
+  if (_line.peek(position++) != ',' || _line.peek(position++) != '"')
+    return false;
+  while (position < _line.size() && _line.peek(position) != '"')
+    position++;
+
+  char text[16];
+  unsigned length = 0;
+  position++;
+  if (_line.peek(position++) != ',' || _line.peek(position++) != '"')
+    return false;
+  while (position < _line.size() && _line.peek(position) != '"' && length < sizeof(text) - 1)
+    text[length++] = _line.peek(position++);
+  text[length] = '\0';
+
+  unsigned long address, port;
+  position++;
+  if (!parseAddress(text, address) || _line.peek(position++) != ',' || !parseUnsigned(_line, position, port))
+    return false;
+
+  links |= 1 << channelId;
+  _remotes[channelId].address = address;
+  _remotes[channelId].port = port;
+  return true;
+}
+
+/// Returns true if _accessPoint holds an access point.
+template <class T>
+bool Esp8266<T>::isKnownAccessPoint() const
+{
+  return _accessPoint.channel >= 1 && _accessPoint.channel <= 14;
+}
+
+/**
+ * Keeps the access point for the next rejoinAccessPoint(), in the EEPROM if
+ * configured.
+ */
+template <class T>
+void Esp8266<T>::rememberAccessPoint()
+{
+#ifdef ESP8266_JOIN_EEPROM_ADDRESS
+  // Spare the EEPROM if the access point did not change
+  AccessPoint stored;
+  EEPROM.get(ESP8266_JOIN_EEPROM_ADDRESS, stored);
+  if (memcmp(&stored, &_accessPoint, sizeof(stored)))
+    EEPROM.put(ESP8266_JOIN_EEPROM_ADDRESS, _accessPoint);
+#endif
+}
+
+/// Returns the first queued command, which is the one in progress.
+template <class T>
+typename Esp8266<T>::Command &Esp8266<T>::currentCommand()
+{
+  return _commands[_firstCommand];
+}
+
+/// Returns the result slot of a command.
+template <class T>
+typename Esp8266<T>::Result &Esp8266<T>::resultOf(CommandId id)
+{
+  return _results[id % ESP8266_COMMAND_QUEUE_SIZE];
+}
+
+/**
+ * Assembles the received characters to reply lines.
+ *
+ * @note No string is created. Complete lines are parsed in place and
+ * discarded, characters exceeding the line buffer are dropped.
+ */
+template <class T>
+void Esp8266<T>::parseReply(char c)
+{
+  if (c == '\n') {
+    parseLine();
+    _line.clear();
+    _matcher.reset();
+    return;
+  }
+
+  if (c == '\r')
+    return;
+
+  ReplyToken token = _matcher.feed(c);
+
+  // The prompt "> " of AT+CIPSEND is not terminated by a line feed
+  if (token == TOKEN_PROMPT && _status == PENDING && _line.isEmpty()) {
+    if (_payloadPending) {
+      writePayload();
+      _matcher.reset();
+      return;
+    }
+
+    if (currentCommand().passthrough) {
+      _passthrough = true;
+      _matcher.reset();
+      finishCommand(SUCCEEDED);
+      return;
+    }
+  }
+
+  _line.push(c);
+
+  // The payload of an "+IPD" message directly follows its header
+  if (c == ':' && token == TOKEN_DATA && parseDataHeader()) {
+    _line.clear();
+    _matcher.reset();
+  }
+}
+
+/**
+ * Checks a complete line for an unsolicited message or the terminal replies
+ * of a command.
+ */
+template <class T>
+void Esp8266<T>::parseLine()
+{
+  ReplyToken token = _matcher.token();
+
+  // Replies without a command in progress are stale, e.g. after a timeout
+  if (parseEvent(token) || _status != PENDING)
+    return;
+
+  switch (token) {
+    case TOKEN_OK:
+    case TOKEN_SEND_OK:
+      // AT+CIPSEND answers "OK" before its prompt, so ignore it until the data was written
+      if (_payloadPending || currentCommand().passthrough)
+        break;
+
+      if (currentCommand().segments)
+        finishPacket();
+      else
+        finishCommand(SUCCEEDED);
+      break;
+
+    case TOKEN_ERROR:
+      finishCommand(_failure);
+      break;
+
+    case TOKEN_FAIL:
+      finishCommand(FAILED);
+      break;
+
+    case TOKEN_SEND_FAIL:
+      finishCommand(SEND_FAILED);
+      break;
+
+    case TOKEN_BUSY:
+      // The module is still processing an earlier command and dropped this one
+      finishCommand(BUSY);
+      break;
+
+    case TOKEN_ALREADY_CONNECTED:
+      _failure = ALREADY_CONNECTED;
+      break;
+
+    default:
+      if (currentCommand().query != NO_QUERY)
+        parseInformation(token);
+      break;
+  }
+}
+
+/**
+ * Dispatches a line if it is an unsolicited message of the module.
+ *
+ * @return True if the line was a message, false if it is a command reply.
+ */
+template <class T>
+bool Esp8266<T>::parseEvent(ReplyToken token)
+{
+  // Link messages are prefixed with "<id>," if multiple connections are enabled
+  unsigned char channelId = 0;
+  if (token == TOKEN_LINK_CONNECT || token == TOKEN_LINK_CLOSED) {
+    channelId = _line.peek(0) - '0';
+
+    // The module has no more links, the line is no message of one
+    if (channelId >= ESP8266_CHANNEL_COUNT)
+      return false;
+  }
+
+  switch (token) {
+    case TOKEN_CONNECT:
+    case TOKEN_LINK_CONNECT:
+      _connectedLinks |= 1 << channelId;
+      _closedLinks &= ~(1 << channelId);
+
+      // Links the driver did not open were accepted by the server
+      if ((_moduleState & STATE_SERVER) && !isOpening(channelId)) {
+        _acceptedLinks |= 1 << channelId;
+        _receiveBuffers[channelId].clear();
+        _datagramLinks &= ~(1 << channelId);
+        forgetDatagrams(channelId);
+        notify(LINK_ACCEPTED, channelId);
+      } else {
+        notify(LINK_CONNECTED, channelId);
+      }
+      break;
+
+    case TOKEN_CLOSED:
+    case TOKEN_LINK_CLOSED:
+      dropLinks(1 << channelId);
+      notify(LINK_CLOSED, channelId);
+      break;
+
+    case TOKEN_WIFI_CONNECTED:
+      notify(WIFI_CONNECTED);
+      break;
+
+    case TOKEN_WIFI_GOT_IP:
+      notify(WIFI_GOT_IP);
+      break;
+
+    case TOKEN_WIFI_DISCONNECT:
+      // No link survives the loss of the access point
+      dropLinks(_connectedLinks);
+
+      // A brown-out reset often shows up as the loss of the access point
+      // while its "ready" is garbled, so the known settings are sent again
+      _moduleState = 0;
+      notify(WIFI_DISCONNECTED);
+      break;
+
+    case TOKEN_READY:
+      // The command in progress was lost with the reset
+      if (_status == PENDING)
+        finishCommand(FAILED);
+
+      dropLinks((1 << ESP8266_CHANNEL_COUNT) - 1);
+      _moduleState = 0;
+      _serverPort = 0;
+
+      // The reset also turned off the flow control of the module
+      if (_flowControl) {
+        SerialFlowControl<T>::set(_serial, false);
+        _flowControl = false;
+      }
+
+      notify(MODULE_READY);
+      break;
+
+    default:
+      return false;
+  }
+
+  return true;
+}
+
+/**
+ * Parses the header of an "+IPD" message in place.
+ *
+ * @note Header := +IPD,[<channel_id>,]<length>:
+ * @return True if the line was a valid header. The payload is received next.
+ */
+template <class T>
+bool Esp8266<T>::parseDataHeader()
+{
+  // +IPD,[<id>,]<length>[,<address>,<port>]:
+  // The channel id is only sent if multiple connections are enabled, the
+  // sender only after AT+CIPDINFO=1
+  unsigned long fields[4];
+  unsigned char count = 0;
+  unsigned char addressField = 0;
+  unsigned long address = 0;
+  unsigned position = _matcher.length();
+  for (;;) {
+    if (count == 4 || !parseUnsigned(_line, position, fields[count]))
+      return false;
+
+    if (_line.peek(position) == '.') {
+      if (addressField || !count)
+        return false;
+
+      address = fields[count];
+      for (unsigned char octet = 1; octet < 4; octet++) {
+        unsigned long value;
+        if (_line.peek(position++) != '.' || !parseUnsigned(_line, position, value) || value > 255)
+          return false;
+        address |= value << (8 * octet);
+      }
+      addressField = count;
+    }
+
+    count++;
+    if (position + 1 >= _line.size())
+      break;
+    if (_line.peek(position++) != ',')
+      return false;
+  }
+
+  // Fields in front of the sender: [<id>,]<length>
+  unsigned char lengthFields = addressField ? addressField : count;
+  if (lengthFields > 2 || (addressField && count != addressField + 2))
+    return false;
+
+  bool hasChannel = lengthFields == 2;
+  _ipdChannel = hasChannel ? fields[0] : 0;
+  _ipdRemaining = fields[lengthFields - 1];
+  _ipdDeadline = millis() + IPD_TIMEOUT;
+
+  if (addressField && _ipdChannel < ESP8266_CHANNEL_COUNT) {
+    _remotes[_ipdChannel].address = address;
+    _remotes[_ipdChannel].port = fields[addressField + 1];
+  }
+
+  // Keep the boundary and the sender of a datagram for readDatagram()
+  _ipdDatagram = false;
+  if (!_dataHandler && _ipdChannel < ESP8266_CHANNEL_COUNT && (_datagramLinks & (1 << _ipdChannel)))
+    recordDatagram(_remotes[_ipdChannel]);
+  return true;
+}
+
+/**
+ * Reads the available payload bytes of an "+IPD" message.
+ *
+ * The module drops the rest of a message it can not send in time and
+ * continues with the next one, so the payload is checked for the header of
+ * an "+IPD" message. Its characters are held back until they can not be part
+ * of a header anymore. A complete header ends the overrun message and is
+ * parsed as the start of the next one.
+ */
+template <class T>
+void Esp8266<T>::receiveData()
+{
+  char buffer[ESP8266_DATA_CHUNK_SIZE];
+  unsigned length = 0;
+
+  // Room is left for the held back characters and the next one
+  while (_ipdRemaining && length + _ipdMatched - _ipdMatchStart < sizeof(buffer) && _serial.available()) {
+    char c = _serial.read();
+    _ipdRemaining--;
+
+    if (c == (char)pgm_read_byte(IPD_HEADER + _ipdMatched)) {
+      _ipdMatched++;
+    } else {
+      length += releaseMatch(buffer + length);
+      if (c == '\r') {
+        _ipdMatched = 1;
+      } else if (c == '+') {
+        _ipdMatchStart = 2;
+        _ipdMatched = 3;
+      } else {
+        buffer[length++] = c;
+      }
+    }
+
+    if (_ipdMatched == IPD_HEADER_LENGTH) {
+      deliverData(buffer, length);
+
+      // The header was no payload
+      abortData(_ipdRemaining + IPD_HEADER_LENGTH - _ipdMatchStart);
+      _ipdMatched = _ipdMatchStart = 0;
+      for (unsigned char i = 2; i < IPD_HEADER_LENGTH; i++)
+        parseReply(pgm_read_byte(IPD_HEADER + i));
+      return;
+    }
+  }
+
+  // The held back characters ended the payload
+  if (!_ipdRemaining)
+    length += releaseMatch(buffer + length);
+
+  _ipdDeadline = millis() + IPD_TIMEOUT;
+  deliverData(buffer, length);
+}
+
+/**
+ * Copies the characters that were held back as the possible start of a
+ * header and forgets them.
+ *
+ * @return The count of copied characters.
+ */
+template <class T>
+unsigned char Esp8266<T>::releaseMatch(char *buffer)
+{
+  unsigned char length = 0;
+  for (unsigned char i = _ipdMatchStart; i < _ipdMatched; i++)
+    buffer[length++] = pgm_read_byte(IPD_HEADER + i);
+
+  _ipdMatched = _ipdMatchStart = 0;
+  return length;
+}
+
+/**
+ * Ends an "+IPD" message that the module cut short.
+ *
+ * @param lost The count of announced bytes that did not arrive.
+ */
+template <class T>
+void Esp8266<T>::abortData(unsigned lost)
+{
+  if (_ipdChannel < ESP8266_CHANNEL_COUNT) {
+    _receiveCounters[_ipdChannel].overruns++;
+    _receiveCounters[_ipdChannel].lostBytes += lost;
+  }
+  _ipdRemaining = 0;
+}
+
+/**
+ * Passes payload bytes of an "+IPD" message to the data handler or the
+ * receive buffer of its channel.
+ *
+ * @note Bytes that do not fit into the receive buffer are dropped. Reading
+ * them later would block the replies of all commands and channels.
+ */
+template <class T>
+void Esp8266<T>::deliverData(const char *buffer, unsigned length)
+{
+  if (!length)
+    return;
+
+  if (_dataHandler) {
+    _dataHandler(_ipdChannel, buffer, length);
+  } else if (_ipdChannel < ESP8266_CHANNEL_COUNT) {
+    // A datagram without an entry could not be told apart from the one before
+    unsigned written = 0;
+    if (_ipdDatagram || !(_datagramLinks & (1 << _ipdChannel)))
+      written = _receiveBuffers[_ipdChannel].write(buffer, length);
+    if (_ipdDatagram)
+      _datagrams[_datagramCount - 1].length += written;
+    _receiveCounters[_ipdChannel].droppedBytes += length - written;
+  }
+}
+
+/**
+ * Returns true if the payload of a datagram is still arriving.
+ */
+template <class T>
+bool Esp8266<T>::isReceiving(unsigned char index) const
+{
+  return _ipdDatagram && _ipdRemaining && index == _datagramCount - 1;
+}
+
+/**
+ * Adds an entry for the datagram whose header was parsed. The datagram is
+ * dropped if all entries are in use.
+ */
+template <class T>
+void Esp8266<T>::recordDatagram(const Remote &sender)
+{
+  if (_datagramCount == ESP8266_DATAGRAM_QUEUE_SIZE)
+    return;
+
+  Datagram &datagram = _datagrams[_datagramCount++];
+  datagram.channelId = _ipdChannel;
+  datagram.length = 0;
+  datagram.sender = sender;
+  _ipdDatagram = true;
+}
+
+template <class T>
+void Esp8266<T>::removeDatagram(unsigned char index)
+{
+  if (index == _datagramCount - 1)
+    _ipdDatagram = false;
+
+  _datagramCount--;
+  for (unsigned char i = index; i < _datagramCount; i++)
+    _datagrams[i] = _datagrams[i + 1];
+}
+
+/**
+ * Removes the bytes read from a channel with read() from its datagrams.
+ */
+template <class T>
+void Esp8266<T>::consumeDatagrams(unsigned char channelId, unsigned count)
+{
+  unsigned char i = 0;
+  while (count && i < _datagramCount) {
+    Datagram &datagram = _datagrams[i];
+    if (datagram.channelId != channelId) {
+      i++;
+      continue;
+    }
+
+    unsigned part = count < datagram.length ? count : datagram.length;
+    datagram.length -= part;
+    count -= part;
+    if (datagram.length || isReceiving(i))
+      i++;
+    else
+      removeDatagram(i);
+  }
+}
+
+/**
+ * Removes the datagrams of a channel whose receive buffer was cleared.
+ */
+template <class T>
+void Esp8266<T>::forgetDatagrams(unsigned char channelId)
+{
+  unsigned char i = 0;
+  while (i < _datagramCount) {
+    if (_datagrams[i].channelId == channelId)
+      removeDatagram(i);
+    else
+      i++;
+  }
+}
+
+/// Returns true if the command in progress opens a link on the channel.
+template <class T>
+bool Esp8266<T>::isOpening(unsigned char channelId) const
+{
+  if (_status != PENDING || !_commandCount)
+    return false;
+
+  const Command &command = _commands[_firstCommand];
+  return command.opensLink && command.channelId == channelId;
+}
+
+/**
+ * Marks links as closed. Their pool entries and pending accepts are dropped.
+ *
+ * @param links One bit per channel.
+ */
+template <class T>
+void Esp8266<T>::dropLinks(unsigned char links)
+{
+  _connectedLinks &= ~links;
+  _acceptedLinks &= ~links;
+  _closedLinks |= links;
+
+  for (unsigned i = 0; i < ESP8266_CHANNEL_COUNT; i++) {
+    if (links & (1 << i))
+      _pool[i].port = 0;
+  }
+}
+
+/// Calls the handler of an unsolicited message.
+template <class T>
+void Esp8266<T>::notify(Event event, unsigned char channelId)
+{
+  if (_eventHandlers[event])
+    _eventHandlers[event](event, channelId);
+}
+
+/**
+ * Parses the information line of a query, e.g. "+CIPMUX:1", in place.
+ */
+template <class T>
+void Esp8266<T>::parseInformation(ReplyToken token)
+{
+  Result &result = resultOf(currentCommand().id);
+  unsigned position = 0;
+
+  switch (currentCommand().query) {
+    case QUERY_MULTIPLE_CONNECTIONS:
+      if (token != TOKEN_CIPMUX)
+        return;
+
+      position = _matcher.length();
+      result.answered = parseUnsigned(_line, position, result.value);
+      break;
+
+    case QUERY_ACCESS_POINT:
+      if (token != TOKEN_CWJAP_CUR)
+        return;
+
+      result.answered = parseAccessPoint(_matcher.length());
+      break;
+
+    case QUERY_LINK_STATUS:
+      // One line per open link, result.value collects their bits
+      if (token != TOKEN_CIPSTATUS)
+        return;
+
+      result.answered = parseLinkStatus(_matcher.length(), result.value);
+      break;
+
+    case QUERY_DOMAIN: {
+      if (token != TOKEN_CIPDOMAIN)
+        return;
+
+      char text[16];
+      unsigned length = 0;
+      for (position = _matcher.length(); position < _line.size() && length < sizeof(text) - 1; position++)
+        text[length++] = _line.peek(position);
+
+      text[length] = '\0';
+      result.answered = parseAddress(text, result.value);
+      break;
+    }
+
+    case NO_QUERY:
+      break;
+  }
+}
+
+/**
+ * Writes the packet of AT+CIPSEND after the module showed its prompt. A
+ * packet may span several segments or only a part of one.
+ */
+template <class T>
+void Esp8266<T>::writePayload()
+{
+  const Command &command = currentCommand();
+  size_t offset = command.delivered;
+  size_t remaining = _packetLength;
+
+  for (unsigned char i = 0; remaining && i < command.segmentCount; i++) {
+    const Segment &segment = command.segments[i];
+    if (offset >= segment.length) {
+      offset -= segment.length;
+      continue;
+    }
+
+    size_t length = segment.length - offset < remaining ? segment.length - offset : remaining;
+    writeSegment(segment, offset, length);
+    remaining -= length;
+    offset = 0;
+  }
+
+  flushOut();
+
+  _payloadPending = false;
+  _deadline = millis() + DEFAULT_TIMEOUT;
+}
+
+/**
+ * Writes a part of a segment, reading it from flash memory if necessary.
+ */
+template <class T>
+void Esp8266<T>::writeSegment(const Segment &segment, size_t offset, size_t length)
+{
+  if (!segment.progmem) {
+    _serial.write(segment.data + offset, length);
+    return;
+  }
+
+  for (size_t i = 0; i < length; i++)
+    _serial.write(pgm_read_byte(segment.data + offset + i));
+}
+
+/**
+ * Finishes the command in progress and sends the next queued command.
+ */
+template <class T>
+void Esp8266<T>::finishCommand(CommandStatus status)
+{
+  _status = status;
+  _payloadPending = false;
+
+  dequeueCommand(status);
+  issueCommand();
+}
+
+/**
+ * Counts a confirmed packet of the send command in progress. The next
+ * packet is announced right away, the command finishes after the last one.
+ */
+template <class T>
+void Esp8266<T>::finishPacket()
+{
+  Command &command = currentCommand();
+  command.delivered += _packetLength;
+  resultOf(command.id).value = command.delivered;
+
+  if (command.delivered < command.payloadLength)
+    issuePacket(command);
+  else
+    finishCommand(SUCCEEDED);
+}
+
+/**
+ * Removes the first queued command, stores its result and notifies the callback.
+ */
+template <class T>
+void Esp8266<T>::dequeueCommand(CommandStatus status)
+{
+  const Command &command = currentCommand();
+  CommandId id = command.id;
+
+  // The settings are unknown if the command failed
+  _moduleState &= ~command.stateMask;
+  if (status == SUCCEEDED)
+    _moduleState |= command.stateValue;
+
+  // The links reported by AT+CIPSTATUS replace the tracked ones
+  if (command.query == QUERY_LINK_STATUS && status == SUCCEEDED) {
+    unsigned char links = resultOf(id).value;
+    dropLinks(((1 << ESP8266_CHANNEL_COUNT) - 1) & ~links);
+    _connectedLinks |= links;
+    _closedLinks &= ~links;
+  }
+
+  resultOf(id).status = status;
+  _firstCommand = (_firstCommand + 1) % ESP8266_COMMAND_QUEUE_SIZE;
+  _commandCount--;
+
+  if (_callback)
+    _callback(id, status);
+}
+
+// -------------------------------------------------------------------------- //
+// Baud rate
+// -------------------------------------------------------------------------- //
+/**
+ * Starts the serial at a rate and switches its flow control along.
+ */
+template <class T>
+void Esp8266<T>::beginSerial(unsigned long baud, bool flowControl)
+{
+  _serial.begin(baud);
+  if (SerialFlowControl<T>::SUPPORTED)
+    SerialFlowControl<T>::set(_serial, flowControl);
+}
+
+/**
+ * Checks if the module answers at the given baud rate.
+ *
+ * @note The probe waits at most PROBE_TIMEOUT and stops at the first
+ * character that can not be part of a reply, which is the typical result of
+ * a wrong baud rate.
+ * @return True if the module answered "OK".
+ */
+template <class T>
+bool Esp8266<T>::probeBaud(unsigned long baud)
+{
+  // The module starts without flow control
+  beginSerial(baud, false);
+  _flowControl = false;
+  flushIn();
+  _line.clear();
+
+  _serial.print(F("AT\r\n"));
+  flushOut();
+
+  return awaitRawLine(REPLY_OK, PROBE_TIMEOUT);
+}
+
+/**
+ * Reads the serial directly, bypassing poll(), until the expected line arrives.
+ *
+ * @note Stops at the first character that can not be part of a reply, which
+ * is the typical result of a wrong baud rate.
+ * @return True if the line arrived before the timeout.
+ */
+template <class T>
+bool Esp8266<T>::awaitRawLine(PGM_P expected, unsigned long timeout)
+{
+  bool found = false;
+
+  unsigned long until = millis() + timeout;
+  while (!found && isFuture(until)) {
+    if (!_serial.available())
+      continue;
+
+    char c = _serial.read();
+    if (!isReplyCharacter(c))
+      break;
+
+    if (c == '\n') {
+      found = _line.equals_P(expected);
+      _line.clear();
+    }
+    else if (c != '\r') {
+      _line.push(c);
+    }
+  }
+
+  _line.clear();
+  return found;
+}
+
+/**
+ * Switches the module and the serial back to a known working baud rate.
+ * Probes all rates if the module does not answer afterwards.
+ */
+template <class T>
+void Esp8266<T>::restoreBaud(unsigned long baud)
+{
+  sendSetCommand(F("UART_CUR"), baud, 8, 1, 0, _flowControl ? 3 : 0);
+
+  beginSerial(baud, _flowControl);
+  flushIn();
+
+  if (isOk())
+    rememberBaud(baud);
+  else
+    configureBaud();
+}
+
+/**
+ * Stores the working baud rate, in the EEPROM if configured.
+ * @return The given rate.
+ */
+template <class T>
+unsigned long Esp8266<T>::rememberBaud(unsigned long baud)
+{
+#ifdef ESP8266_BAUD_EEPROM_ADDRESS
+  // Spare the EEPROM if the rate did not change
+  unsigned long storedBaud;
+  EEPROM.get(ESP8266_BAUD_EEPROM_ADDRESS, storedBaud);
+  if (storedBaud != baud)
+    EEPROM.put(ESP8266_BAUD_EEPROM_ADDRESS, baud);
+#endif
+
+  _baud = baud;
+  _moduleState |= STATE_BAUD;
+  return baud;
+}
+
+/// Returns the name of a protocol used by AT+CIPSTART (program memory).
+template <class T>
+const __FlashStringHelper *Esp8266<T>::protocolName(ProtocolMode mode)
+{
+  switch (mode) {
+    case UDP:
+      return F("UDP");
+    case TLS:
+      return F("SSL");
+    default:
+      return F("TCP");
+  }
+}
+
+/**
+ * Formats a set command directly to the serial, including the tailing line
+ * feed of AT-commands.
+ *
+ * @note Pending input is not flushed, it may contain unsolicited messages
+ * that are dispatched by poll().
+ */
+template <class T>
+template <typename ... Types>
+void Esp8266<T>::sendSetCommand(const __FlashStringHelper *command, const Types &...parameters) const
+{
+  printSetCommand(_serial, command, parameters...);
+  _serial.print(F("\r\n"));
+  flushOut();
+}
 
 #endif
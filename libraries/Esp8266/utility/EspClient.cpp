@@ -0,0 +1,201 @@
+/**
+ *  @file
+ *  @brief Arduino Client on top of a channel of an Esp8266 module.
+ *  @author Joern Hoffmann <jhoffmann@informatik.uni-leipzig.de>
+ *  @author Joern Hoffmann <j.hoffmann@xceeth.com>
+ *  @version 1.0
+ *
+ *  @section LICENSE
+ *
+ *  The MIT License (MIT)
+ *  Copyright (c) 2015 Joern Hoffmann
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifdef __ESPCLIENT_H__
+
+// -------------------------------------------------------------------------- //
+// Public
+// -------------------------------------------------------------------------- //
+
+template <class T>
+EspClient<T>::EspClient(Esp8266<T> &esp, unsigned char channelId)
+  : _esp(esp), _channelId(channelId), _writeLength(0)
+{
+}
+
+template <class T>
+int EspClient<T>::connect(IPAddress ip, uint16_t port)
+{
+  String host;
+  host.reserve(15);
+  for (int i = 0; i < 4; i++) {
+    if (i)
+      host += '.';
+    host += ip[i];
+  }
+
+  return connect(host, port);
+}
+
+template <class T>
+int EspClient<T>::connect(const char *host, uint16_t port)
+{
+  return connect(String(host), port);
+}
+
+template <class T>
+size_t EspClient<T>::write(uint8_t c)
+{
+  if (_writeLength == sizeof(_writeBuffer))
+    flush();
+
+  if (getWriteError())
+    return 0;
+
+  _writeBuffer[_writeLength++] = c;
+  return 1;
+}
+
+template <class T>
+size_t EspClient<T>::write(const uint8_t *buffer, size_t size)
+{
+  // Large writes are sent directly instead of being copied in small pieces
+  if (size >= sizeof(_writeBuffer)) {
+    flush();
+    if (getWriteError())
+      return 0;
+
+    size_t delivered = _esp.write(_channelId, (const char *)buffer, size);
+    if (delivered < size)
+      setWriteError();
+
+    return delivered;
+  }
+
+  size_t written = 0;
+  while (written < size) {
+    if (_writeLength == sizeof(_writeBuffer))
+      flush();
+
+    if (getWriteError())
+      break;
+
+    size_t length = size - written;
+    if (length > sizeof(_writeBuffer) - _writeLength)
+      length = sizeof(_writeBuffer) - _writeLength;
+
+    memcpy(_writeBuffer + _writeLength, buffer + written, length);
+    _writeLength += length;
+    written += length;
+  }
+
+  return written;
+}
+
+template <class T>
+int EspClient<T>::available()
+{
+  // Buffered writes are usually the request the caller waits a response for
+  flush();
+  _esp.poll();
+  return _esp.available(_channelId);
+}
+
+template <class T>
+int EspClient<T>::read()
+{
+  flush();
+  _esp.poll();
+  return _esp.read(_channelId);
+}
+
+template <class T>
+int EspClient<T>::read(uint8_t *buffer, size_t size)
+{
+  flush();
+  _esp.poll();
+  if (!_esp.available(_channelId))
+    return -1;
+
+  return _esp.read(_channelId, (char *)buffer, size);
+}
+
+template <class T>
+int EspClient<T>::peek()
+{
+  flush();
+  _esp.poll();
+  return _esp.peek(_channelId);
+}
+
+template <class T>
+void EspClient<T>::flush()
+{
+  if (!_writeLength)
+    return;
+
+  if (_esp.write(_channelId, _writeBuffer, _writeLength) < _writeLength)
+    setWriteError();
+
+  _writeLength = 0;
+}
+
+template <class T>
+void EspClient<T>::stop()
+{
+  flush();
+
+  if (_esp.isConnected(_channelId))
+    _esp.disconnect(_channelId);
+
+  // Data that was not read is stale
+  while (_esp.read(_channelId) >= 0)
+    ;
+}
+
+template <class T>
+uint8_t EspClient<T>::connected()
+{
+  flush();
+  return _esp.isConnected(_channelId) || available();
+}
+
+template <class T>
+EspClient<T>::operator bool()
+{
+  return _esp.isConnected(_channelId);
+}
+
+// -------------------------------------------------------------------------- //
+// Private
+// -------------------------------------------------------------------------- //
+
+template <class T>
+bool EspClient<T>::connect(const String &host, uint16_t port)
+{
+  _writeLength = 0;
+  clearWriteError();
+
+  return _esp.connect(_channelId, host, port);
+}
+
+#endif
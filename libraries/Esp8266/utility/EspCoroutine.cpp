@@ -0,0 +1,293 @@
+/**
+ *  @file
+ *  @brief C++20 coroutines on top of the asynchronous interface of Esp8266 modules.
+ *  @author Joern Hoffmann <jhoffmann@informatik.uni-leipzig.de>
+ *  @author Joern Hoffmann <j.hoffmann@xceeth.com>
+ *  @version 1.0
+ *
+ *  @section LICENSE
+ *
+ *  The MIT License (MIT)
+ *  Copyright (c) 2015 Joern Hoffmann
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#ifdef __ESPCOROUTINE_H__
+#include <exception>
+
+// -------------------------------------------------------------------------- //
+// EspTask
+// -------------------------------------------------------------------------- //
+
+inline EspTask EspTask::promise_type::get_return_object()
+{
+  return EspTask(Handle::from_promise(*this));
+}
+
+inline void EspTask::promise_type::unhandled_exception()
+{
+  // A failed coroutine can not be resumed, the scheduler would lose track of it
+  std::terminate();
+}
+
+inline EspTask::EspTask(Handle handle)
+  : _handle(handle)
+{
+}
+
+inline EspTask::EspTask(EspTask &&other) noexcept
+  : _handle(other._handle)
+{
+  other._handle = nullptr;
+}
+
+inline EspTask::~EspTask()
+{
+  // Only a task that was never spawned still owns its coroutine
+  if (_handle)
+    _handle.destroy();
+}
+
+// -------------------------------------------------------------------------- //
+// EspScheduler
+// -------------------------------------------------------------------------- //
+
+template <class T>
+void EspScheduler::attach(Esp8266<T> &esp)
+{
+  Module module;
+  module.esp = &esp;
+  module.poll = [](void *esp) { static_cast<Esp8266<T> *>(esp)->poll(); };
+  _modules.push_back(module);
+}
+
+inline void EspScheduler::spawn(EspTask &&task)
+{
+  EspTask::Handle handle = task._handle;
+  if (!handle)
+    return;
+
+  task._handle = nullptr;
+  handle.promise().scheduler = this;
+  _tasks.push_back(handle);
+  _runnable.push_back(handle);
+}
+
+inline bool EspScheduler::runOnce()
+{
+  for (const Module &module : _modules)
+    module.poll(module.esp);
+
+  // Results are latched before any coroutine runs, the commands it submits
+  // may reuse the result slots of older commands
+  for (size_t i = 0; i < _waiters.size(); ) {
+    if (_waiters[i].ready(_waiters[i].awaiter)) {
+      _runnable.push_back(_waiters[i].handle);
+      _waiters[i] = _waiters.back();
+      _waiters.pop_back();
+    } else {
+      i++;
+    }
+  }
+
+  std::vector<std::coroutine_handle<>> runnable;
+  runnable.swap(_runnable);
+  for (std::coroutine_handle<> handle : runnable)
+    handle.resume();
+
+  reap();
+  return !_tasks.empty();
+}
+
+inline void EspScheduler::run()
+{
+  while (runOnce())
+    ;
+}
+
+inline size_t EspScheduler::size() const
+{
+  return _tasks.size();
+}
+
+inline void EspScheduler::wait(std::coroutine_handle<> handle, bool (*ready)(void *awaiter), void *awaiter)
+{
+  Waiter waiter;
+  waiter.handle = handle;
+  waiter.ready = ready;
+  waiter.awaiter = awaiter;
+  _waiters.push_back(waiter);
+}
+
+inline void EspScheduler::reap()
+{
+  for (size_t i = 0; i < _tasks.size(); ) {
+    if (_tasks[i].done()) {
+      _tasks[i].destroy();
+      _tasks[i] = _tasks.back();
+      _tasks.pop_back();
+    } else {
+      i++;
+    }
+  }
+}
+
+// -------------------------------------------------------------------------- //
+// EspCoroutine
+// -------------------------------------------------------------------------- //
+
+template <class T>
+EspCoroutine<T>::EspCoroutine(Esp8266<T> &esp)
+  : _esp(esp)
+{
+}
+
+template <class T>
+Esp8266<T> &EspCoroutine<T>::module()
+{
+  return _esp;
+}
+
+template <class T>
+typename EspCoroutine<T>::CommandAwaiter EspCoroutine<T>::command(CommandId id)
+{
+  return CommandAwaiter(_esp, id);
+}
+
+template <class T>
+typename EspCoroutine<T>::CommandAwaiter EspCoroutine<T>::connect(unsigned char channelId, const String &addr, unsigned port, ProtocolMode mode)
+{
+  Esp8266<T> &esp = _esp;
+  return CommandAwaiter(esp, [&esp, channelId, addr, port, mode]() { return esp.connectAsync(channelId, addr, port, mode); });
+}
+
+template <class T>
+typename EspCoroutine<T>::CommandAwaiter EspCoroutine<T>::disconnect(unsigned char channelId)
+{
+  Esp8266<T> &esp = _esp;
+  return CommandAwaiter(esp, [&esp, channelId]() { return esp.disconnectAsync(channelId); });
+}
+
+template <class T>
+typename EspCoroutine<T>::CommandAwaiter EspCoroutine<T>::send(unsigned char channelId, const char *bytes, size_t length)
+{
+  Esp8266<T> &esp = _esp;
+  return CommandAwaiter(esp, [&esp, channelId, bytes, length]() { return esp.sendAsync(channelId, bytes, length); });
+}
+
+template <class T>
+typename EspCoroutine<T>::ReceiveAwaiter EspCoroutine<T>::receive(unsigned char channelId, char *buffer, unsigned length)
+{
+  return ReceiveAwaiter(_esp, channelId, buffer, length);
+}
+
+// -------------------------------------------------------------------------- //
+// Awaiters
+// -------------------------------------------------------------------------- //
+
+template <class T>
+EspCoroutine<T>::CommandAwaiter::CommandAwaiter(Esp8266<T> &esp, CommandId id)
+  : _esp(esp), _id(id), _status(Esp8266<T>::PENDING)
+{
+}
+
+template <class T>
+EspCoroutine<T>::CommandAwaiter::CommandAwaiter(Esp8266<T> &esp, std::function<CommandId()> submit)
+  : _esp(esp), _submit(submit), _id(submit()), _status(Esp8266<T>::PENDING)
+{
+}
+
+template <class T>
+bool EspCoroutine<T>::CommandAwaiter::await_ready()
+{
+  return ready(this);
+}
+
+template <class T>
+void EspCoroutine<T>::CommandAwaiter::await_suspend(EspTask::Handle handle)
+{
+  handle.promise().scheduler->wait(handle, &ready, this);
+}
+
+template <class T>
+bool EspCoroutine<T>::CommandAwaiter::await_resume() const
+{
+  return _status == Esp8266<T>::SUCCEEDED;
+}
+
+template <class T>
+typename EspCoroutine<T>::CommandStatus EspCoroutine<T>::CommandAwaiter::status() const
+{
+  return _status;
+}
+
+template <class T>
+bool EspCoroutine<T>::CommandAwaiter::ready(void *awaiter)
+{
+  CommandAwaiter &self = *static_cast<CommandAwaiter *>(awaiter);
+
+  // A full queue frees a slot with each finished command, so the command is
+  // submitted again each round. It only fails if it does not fit into the
+  // empty queue either.
+  if (!self._id && self._submit) {
+    bool full = self._esp.isBusy();
+    self._id = self._submit();
+    if (!self._id && full)
+      return false;
+  }
+
+  self._status = self._id ? self._esp.getCommandStatus(self._id) : Esp8266<T>::FAILED;
+  return self._status != Esp8266<T>::PENDING;
+}
+
+template <class T>
+EspCoroutine<T>::ReceiveAwaiter::ReceiveAwaiter(Esp8266<T> &esp, unsigned char channelId, char *buffer, unsigned length)
+  : _esp(esp), _channelId(channelId), _buffer(buffer), _length(length)
+{
+}
+
+template <class T>
+bool EspCoroutine<T>::ReceiveAwaiter::await_ready()
+{
+  return ready(this);
+}
+
+template <class T>
+void EspCoroutine<T>::ReceiveAwaiter::await_suspend(EspTask::Handle handle)
+{
+  handle.promise().scheduler->wait(handle, &ready, this);
+}
+
+template <class T>
+unsigned EspCoroutine<T>::ReceiveAwaiter::await_resume()
+{
+  return _esp.read(_channelId, _buffer, _length);
+}
+
+template <class T>
+bool EspCoroutine<T>::ReceiveAwaiter::ready(void *awaiter)
+{
+  ReceiveAwaiter &self = *static_cast<ReceiveAwaiter *>(awaiter);
+  return self._esp.available(self._channelId) || !self._esp.isConnected(self._channelId);
+}
+
+#endif
@@ -40,10 +40,20 @@ public:
   void begin(unsigned long baud)
   { }
 
+  using FakeStreamBuffer::write;
+
+  size_t write(uint8_t val)
+  {
+    writeString += (char)val;
+    return FakeStreamBuffer::write(val);
+  }
+
   unsigned int write(const char *buffer, unsigned int length)
   {
-    writeString += buffer;
-    return strlen(buffer);
+    for (unsigned int i = 0; i < length; i++)
+      write((uint8_t)buffer[i]);
+
+    return length;
   }
 
   const String& getWrittenString() const
@@ -36,18 +36,35 @@
 static const char PLUS = '+';
 static const char COMMA = ',';
 static const char COLON = ':';
+
+// Header of the next message within an overrun payload, up to its channel id
+static const char IPD_HEADER[] PROGMEM = "\r\n+IPD,";
+static const unsigned char IPD_HEADER_LENGTH = sizeof(IPD_HEADER) - 1;
+
 // -------------------------------------------------------------------------- //
 // Public
 // -------------------------------------------------------------------------- //
 IPDParser::IPDParser (Stream &stream) : _stream(stream)
 {
   reset();
+  clearReceiveCounters();
 }
 
 bool IPDParser::parse()
 {
+  // The header was read up to the channel id by readPayload() already
+  bool headerFound = _headerFound;
   reset();
 
+  if (headerFound) {
+    nextsym();
+    if (headerFields())
+      return true;
+
+    reset();
+    return false;
+  }
+
   do {
     nextsym();
   } while(isJunk());
@@ -81,23 +98,66 @@ unsigned int IPDParser::getChannelId() const
 
 unsigned int IPDParser::readPayload(char *buffer, unsigned int bufferSize)
 {
-  if (!buffer || bufferSize == 0 || _payloadLength == 0)
+  if (!buffer || bufferSize == 0 || (_payloadLength == 0 && _matched == _matchStart))
     return 0;
 
-  // Reads the minimum allowed count of bytes and writes it to the receiving buffer
-  unsigned int bytesToRead = min(bufferSize, _payloadLength);
-  unsigned int readBytes   = _stream.readBytes(buffer, bytesToRead);
+  unsigned int readBytes = 0;
 
-  // Update the remaining bytes
-  if (!reducePayloadLength(readBytes))  {
-    // We should not run into here.
-    readBytes = 0;
-    reset();
+  // Room is left for the held back characters and the next one
+  while (_payloadLength && readBytes + _matched - _matchStart < bufferSize) {
+    char c;
+    if (!_stream.readBytes(&c, 1)) {
+      // The stream timed out within the payload, the missing bytes were overrun
+      abortPayload(_payloadLength);
+      break;
+    }
+    _payloadLength--;
+
+    if (c == (char)pgm_read_byte(IPD_HEADER + _matched)) {
+      _matched++;
+    } else {
+      readBytes += releaseMatch(buffer + readBytes, bufferSize - readBytes);
+      if (c == '\r') {
+        _matched = 1;
+      } else if (c == PLUS) {
+        _matchStart = 2;
+        _matched = 3;
+      } else {
+        buffer[readBytes++] = c;
+      }
+    }
+
+    if (_matched == IPD_HEADER_LENGTH) {
+      // The header was no payload
+      abortPayload(_payloadLength + IPD_HEADER_LENGTH - _matchStart);
+      _matched = _matchStart = 0;
+      _headerFound = true;
+      return readBytes;
+    }
   }
 
+  // The held back characters ended the payload, a buffer shorter than them
+  // gets them piece by piece
+  if (!_payloadLength || !readBytes)
+    readBytes += releaseMatch(buffer + readBytes, bufferSize - readBytes);
+
   return readBytes;
 }
 
+IPDParser::ReceiveCounters IPDParser::getReceiveCounters(unsigned int channelId) const
+{
+  ReceiveCounters counters = { 0, 0 };
+  return channelId < CHANNEL_COUNT ? _receiveCounters[channelId] : counters;
+}
+
+void IPDParser::clearReceiveCounters()
+{
+  for (unsigned int i = 0; i < CHANNEL_COUNT; i++) {
+    _receiveCounters[i].overruns = 0;
+    _receiveCounters[i].lostBytes = 0;
+  }
+}
+
 
 String IPDParser::getPayload()
 {
@@ -125,6 +185,8 @@ void IPDParser::reset()
   symbol = -1;
   _channelId = 0;
   _payloadLength = 0;
+  _matched = _matchStart = 0;
+  _headerFound = false;
 }
 
 // -------------------------------------------------------------------------- //
@@ -225,6 +287,14 @@ bool IPDParser::header()
   if (!expect(COMMA))
     return false;
 
+  return headerFields();
+}
+
+/*
+ *  Header fields := <channel_id>,<length>:
+ */
+bool IPDParser::headerFields()
+{
   // Parse the the cannel number
   if (!channel())
     return false;
@@ -254,6 +324,32 @@ bool IPDParser::isJunk()
   return true;
 }
 
+/*
+ * Copies the characters that were held back as the possible start of a
+ * header, as many as fit into the buffer, and forgets them.
+ */
+unsigned int IPDParser::releaseMatch(char *buffer, unsigned int bufferSize)
+{
+  unsigned int length = 0;
+  while (_matchStart < _matched && length < bufferSize)
+    buffer[length++] = pgm_read_byte(IPD_HEADER + _matchStart++);
+
+  if (_matchStart == _matched)
+    _matched = _matchStart = 0;
+
+  return length;
+}
+
+// Ends a payload that the module cut short, lost is the count of missing bytes
+void IPDParser::abortPayload(unsigned long lost)
+{
+  if (_channelId < CHANNEL_COUNT) {
+    _receiveCounters[_channelId].overruns++;
+    _receiveCounters[_channelId].lostBytes += lost;
+  }
+  _payloadLength = 0;
+}
+
 bool IPDParser::accept(const char s)
 {
   if (symbol == s) {
@@ -0,0 +1,122 @@
+/**
+ *  @file
+ *  @brief Single-pass matcher for the reply lines of the module.
+ *  @author Joern Hoffmann <jhoffmann@informatik.uni-leipzig.de>
+ *  @author Joern Hoffmann <j.hoffmann@xceeth.com>
+ *  @version 1.0
+ *
+ *  @section LICENSE
+ *
+ *  The MIT License (MIT)
+ *  Copyright (c) 2015 Joern Hoffmann
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+
+#ifndef __REPLY_MATCHER_H__
+#define __REPLY_MATCHER_H__
+
+#include <Arduino.h>
+#include <utility/ReplyTokens.h>
+
+/**
+ * Recognizes the token a reply line starts with while the line is received.
+ * Each byte advances the automaton of ReplyTokens.h by one step, so every
+ * token is watched at once and no line is compared afterwards.
+ */
+class ReplyMatcher
+{
+public:
+  ReplyMatcher() : _state(0), _length(0)
+  { }
+
+  /**
+   * Starts a new line.
+   */
+  void reset()
+  {
+    _state = 0;
+    _length = 0;
+  }
+
+  /**
+   * Consumes the next byte of the line.
+   * @return The prefix token that was recognized so far or TOKEN_NONE.
+   */
+  ReplyToken feed(char c)
+  {
+    if (_state == NO_MATCH || isPrefix())
+      return prefixToken();
+
+    unsigned char first = pgm_read_byte(&REPLY_STATES[_state][0]);
+    unsigned char count = pgm_read_byte(&REPLY_STATES[_state][1]);
+
+    _state = NO_MATCH;
+    for (unsigned char i = first; i < first + count; i++) {
+      if ((char)pgm_read_byte(&REPLY_EDGES[i][0]) == c) {
+        _state = pgm_read_byte(&REPLY_EDGES[i][1]);
+        _length++;
+        break;
+      }
+    }
+
+    return prefixToken();
+  }
+
+  /**
+   * Returns the token of the line received so far, i.e. a prefix token or a
+   * token that matched the whole line.
+   */
+  ReplyToken token() const
+  {
+    if (_state == NO_MATCH)
+      return TOKEN_NONE;
+
+    return (ReplyToken)pgm_read_byte(&REPLY_STATES[_state][2]);
+  }
+
+  /**
+   * Returns the length of the matched text, i.e. the position of the
+   * arguments behind a prefix token.
+   */
+  unsigned char length() const
+  {
+    return _length;
+  }
+
+private:
+  static const unsigned char NO_MATCH = 0xFF;
+
+  unsigned char _state;
+  unsigned char _length;
+
+  bool isPrefix() const
+  {
+    return pgm_read_byte(&REPLY_STATES[_state][3]);
+  }
+
+  ReplyToken prefixToken() const
+  {
+    return _state != NO_MATCH && isPrefix() ? token() : TOKEN_NONE;
+  }
+};
+
+#endif // __REPLY_MATCHER_H__
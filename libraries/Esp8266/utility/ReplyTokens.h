@@ -0,0 +1,366 @@
+/**
+ *  @file
+ *  @brief Reply tokens of the module, generated by extras/generate_reply_tokens.py.
+ *  @author Joern Hoffmann <jhoffmann@informatik.uni-leipzig.de>
+ *  @author Joern Hoffmann <j.hoffmann@xceeth.com>
+ *  @version 1.0
+ *
+ *  @section LICENSE
+ *
+ *  The MIT License (MIT)
+ *  Copyright (c) 2015 Joern Hoffmann
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+// Generated by extras/generate_reply_tokens.py, do not edit.
+
+#ifndef __REPLY_TOKENS_H__
+#define __REPLY_TOKENS_H__
+
+#include <Arduino.h>
+
+typedef enum {
+  TOKEN_NONE,
+  TOKEN_PROMPT,              ///< Prefix ">"
+  TOKEN_OK,                  ///< "OK"
+  TOKEN_SEND_OK,             ///< "SEND OK"
+  TOKEN_ERROR,               ///< "ERROR"
+  TOKEN_FAIL,                ///< "FAIL"
+  TOKEN_SEND_FAIL,           ///< "SEND FAIL"
+  TOKEN_ALREADY_CONNECTED,   ///< "ALREADY CONNECTED"
+  TOKEN_BUSY,                ///< Prefix "busy "
+  TOKEN_CONNECT,             ///< "CONNECT"
+  TOKEN_CLOSED,              ///< "CLOSED"
+  TOKEN_LINK_CONNECT,        ///< "#,CONNECT"
+  TOKEN_LINK_CLOSED,         ///< "#,CLOSED"
+  TOKEN_WIFI_CONNECTED,      ///< "WIFI CONNECTED"
+  TOKEN_WIFI_GOT_IP,         ///< "WIFI GOT IP"
+  TOKEN_WIFI_DISCONNECT,     ///< "WIFI DISCONNECT"
+  TOKEN_READY,               ///< "ready"
+  TOKEN_DATA,                ///< Prefix "+IPD,"
+  TOKEN_CIPMUX,              ///< Prefix "+CIPMUX:"
+  TOKEN_CIPDOMAIN,           ///< Prefix "+CIPDOMAIN:"
+  TOKEN_CWJAP_CUR,           ///< Prefix "+CWJAP_CUR:"
+  TOKEN_CIPSTATUS,           ///< Prefix "+CIPSTATUS:"
+} ReplyToken;
+
+static const unsigned char REPLY_STATE_COUNT = 142;
+
+// Per state: first edge, edge count, token and 1 for a prefix token
+static const unsigned char REPLY_STATES[][4] PROGMEM = {
+  {   0, 21,  0, 0 },  // 0
+  {  21,  0,  1, 1 },  // 1
+  {  21,  1,  0, 0 },  // 2
+  {  22,  0,  2, 0 },  // 3
+  {  22,  1,  0, 0 },  // 4
+  {  23,  1,  0, 0 },  // 5
+  {  24,  1,  0, 0 },  // 6
+  {  25,  1,  0, 0 },  // 7
+  {  26,  2,  0, 0 },  // 8
+  {  28,  1,  0, 0 },  // 9
+  {  29,  0,  3, 0 },  // 10
+  {  29,  1,  0, 0 },  // 11
+  {  30,  1,  0, 0 },  // 12
+  {  31,  1,  0, 0 },  // 13
+  {  32,  1,  0, 0 },  // 14
+  {  33,  0,  4, 0 },  // 15
+  {  33,  1,  0, 0 },  // 16
+  {  34,  1,  0, 0 },  // 17
+  {  35,  1,  0, 0 },  // 18
+  {  36,  0,  5, 0 },  // 19
+  {  36,  1,  0, 0 },  // 20
+  {  37,  1,  0, 0 },  // 21
+  {  38,  1,  0, 0 },  // 22
+  {  39,  0,  6, 0 },  // 23
+  {  39,  1,  0, 0 },  // 24
+  {  40,  1,  0, 0 },  // 25
+  {  41,  1,  0, 0 },  // 26
+  {  42,  1,  0, 0 },  // 27
+  {  43,  1,  0, 0 },  // 28
+  {  44,  1,  0, 0 },  // 29
+  {  45,  1,  0, 0 },  // 30
+  {  46,  1,  0, 0 },  // 31
+  {  47,  1,  0, 0 },  // 32
+  {  48,  1,  0, 0 },  // 33
+  {  49,  1,  0, 0 },  // 34
+  {  50,  1,  0, 0 },  // 35
+  {  51,  1,  0, 0 },  // 36
+  {  52,  1,  0, 0 },  // 37
+  {  53,  1,  0, 0 },  // 38
+  {  54,  1,  0, 0 },  // 39
+  {  55,  0,  7, 0 },  // 40
+  {  55,  1,  0, 0 },  // 41
+  {  56,  1,  0, 0 },  // 42
+  {  57,  1,  0, 0 },  // 43
+  {  58,  1,  0, 0 },  // 44
+  {  59,  0,  8, 1 },  // 45
+  {  59,  2,  0, 0 },  // 46
+  {  61,  1,  0, 0 },  // 47
+  {  62,  1,  0, 0 },  // 48
+  {  63,  1,  0, 0 },  // 49
+  {  64,  1,  0, 0 },  // 50
+  {  65,  1,  0, 0 },  // 51
+  {  66,  0,  9, 0 },  // 52
+  {  66,  1,  0, 0 },  // 53
+  {  67,  1,  0, 0 },  // 54
+  {  68,  1,  0, 0 },  // 55
+  {  69,  1,  0, 0 },  // 56
+  {  70,  0, 10, 0 },  // 57
+  {  70,  1,  0, 0 },  // 58
+  {  71,  1,  0, 0 },  // 59
+  {  72,  2,  0, 0 },  // 60
+  {  74,  1,  0, 0 },  // 61
+  {  75,  1,  0, 0 },  // 62
+  {  76,  1,  0, 0 },  // 63
+  {  77,  1,  0, 0 },  // 64
+  {  78,  1,  0, 0 },  // 65
+  {  79,  0, 11, 0 },  // 66
+  {  79,  1,  0, 0 },  // 67
+  {  80,  1,  0, 0 },  // 68
+  {  81,  1,  0, 0 },  // 69
+  {  82,  1,  0, 0 },  // 70
+  {  83,  0, 12, 0 },  // 71
+  {  83,  1,  0, 0 },  // 72
+  {  84,  1,  0, 0 },  // 73
+  {  85,  1,  0, 0 },  // 74
+  {  86,  1,  0, 0 },  // 75
+  {  87,  3,  0, 0 },  // 76
+  {  90,  1,  0, 0 },  // 77
+  {  91,  1,  0, 0 },  // 78
+  {  92,  1,  0, 0 },  // 79
+  {  93,  1,  0, 0 },  // 80
+  {  94,  1,  0, 0 },  // 81
+  {  95,  1,  0, 0 },  // 82
+  {  96,  1,  0, 0 },  // 83
+  {  97,  1,  0, 0 },  // 84
+  {  98,  0, 13, 0 },  // 85
+  {  98,  1,  0, 0 },  // 86
+  {  99,  1,  0, 0 },  // 87
+  { 100,  1,  0, 0 },  // 88
+  { 101,  1,  0, 0 },  // 89
+  { 102,  1,  0, 0 },  // 90
+  { 103,  0, 14, 0 },  // 91
+  { 103,  1,  0, 0 },  // 92
+  { 104,  1,  0, 0 },  // 93
+  { 105,  1,  0, 0 },  // 94
+  { 106,  1,  0, 0 },  // 95
+  { 107,  1,  0, 0 },  // 96
+  { 108,  1,  0, 0 },  // 97
+  { 109,  1,  0, 0 },  // 98
+  { 110,  1,  0, 0 },  // 99
+  { 111,  1,  0, 0 },  // 100
+  { 112,  0, 15, 0 },  // 101
+  { 112,  1,  0, 0 },  // 102
+  { 113,  1,  0, 0 },  // 103
+  { 114,  1,  0, 0 },  // 104
+  { 115,  1,  0, 0 },  // 105
+  { 116,  0, 16, 0 },  // 106
+  { 116,  2,  0, 0 },  // 107
+  { 118,  1,  0, 0 },  // 108
+  { 119,  1,  0, 0 },  // 109
+  { 120,  1,  0, 0 },  // 110
+  { 121,  0, 17, 1 },  // 111
+  { 121,  2,  0, 0 },  // 112
+  { 123,  1,  0, 0 },  // 113
+  { 124,  3,  0, 0 },  // 114
+  { 127,  1,  0, 0 },  // 115
+  { 128,  1,  0, 0 },  // 116
+  { 129,  1,  0, 0 },  // 117
+  { 130,  0, 18, 1 },  // 118
+  { 130,  1,  0, 0 },  // 119
+  { 131,  1,  0, 0 },  // 120
+  { 132,  1,  0, 0 },  // 121
+  { 133,  1,  0, 0 },  // 122
+  { 134,  1,  0, 0 },  // 123
+  { 135,  1,  0, 0 },  // 124
+  { 136,  0, 19, 1 },  // 125
+  { 136,  1,  0, 0 },  // 126
+  { 137,  1,  0, 0 },  // 127
+  { 138,  1,  0, 0 },  // 128
+  { 139,  1,  0, 0 },  // 129
+  { 140,  1,  0, 0 },  // 130
+  { 141,  1,  0, 0 },  // 131
+  { 142,  1,  0, 0 },  // 132
+  { 143,  1,  0, 0 },  // 133
+  { 144,  0, 20, 1 },  // 134
+  { 144,  1,  0, 0 },  // 135
+  { 145,  1,  0, 0 },  // 136
+  { 146,  1,  0, 0 },  // 137
+  { 147,  1,  0, 0 },  // 138
+  { 148,  1,  0, 0 },  // 139
+  { 149,  1,  0, 0 },  // 140
+  { 150,  0, 21, 1 },  // 141
+};
+
+// Per edge: character and next state, sorted by character per state
+static const unsigned char REPLY_EDGES[][2] PROGMEM = {
+  { '+', 107 },
+  { '0',  58 },
+  { '1',  58 },
+  { '2',  58 },
+  { '3',  58 },
+  { '4',  58 },
+  { '5',  58 },
+  { '6',  58 },
+  { '7',  58 },
+  { '8',  58 },
+  { '9',  58 },
+  { '>',   1 },
+  { 'A',  24 },
+  { 'C',  46 },
+  { 'E',  11 },
+  { 'F',  16 },
+  { 'O',   2 },
+  { 'S',   4 },
+  { 'W',  72 },
+  { 'b',  41 },
+  { 'r', 102 },
+  { 'K',   3 },
+  { 'E',   5 },
+  { 'N',   6 },
+  { 'D',   7 },
+  { ' ',   8 },
+  { 'F',  20 },
+  { 'O',   9 },
+  { 'K',  10 },
+  { 'R',  12 },
+  { 'R',  13 },
+  { 'O',  14 },
+  { 'R',  15 },
+  { 'A',  17 },
+  { 'I',  18 },
+  { 'L',  19 },
+  { 'A',  21 },
+  { 'I',  22 },
+  { 'L',  23 },
+  { 'L',  25 },
+  { 'R',  26 },
+  { 'E',  27 },
+  { 'A',  28 },
+  { 'D',  29 },
+  { 'Y',  30 },
+  { ' ',  31 },
+  { 'C',  32 },
+  { 'O',  33 },
+  { 'N',  34 },
+  { 'N',  35 },
+  { 'E',  36 },
+  { 'C',  37 },
+  { 'T',  38 },
+  { 'E',  39 },
+  { 'D',  40 },
+  { 'u',  42 },
+  { 's',  43 },
+  { 'y',  44 },
+  { ' ',  45 },
+  { 'L',  53 },
+  { 'O',  47 },
+  { 'N',  48 },
+  { 'N',  49 },
+  { 'E',  50 },
+  { 'C',  51 },
+  { 'T',  52 },
+  { 'O',  54 },
+  { 'S',  55 },
+  { 'E',  56 },
+  { 'D',  57 },
+  { ',',  59 },
+  { 'C',  60 },
+  { 'L',  67 },
+  { 'O',  61 },
+  { 'N',  62 },
+  { 'N',  63 },
+  { 'E',  64 },
+  { 'C',  65 },
+  { 'T',  66 },
+  { 'O',  68 },
+  { 'S',  69 },
+  { 'E',  70 },
+  { 'D',  71 },
+  { 'I',  73 },
+  { 'F',  74 },
+  { 'I',  75 },
+  { ' ',  76 },
+  { 'C',  77 },
+  { 'D',  92 },
+  { 'G',  86 },
+  { 'O',  78 },
+  { 'N',  79 },
+  { 'N',  80 },
+  { 'E',  81 },
+  { 'C',  82 },
+  { 'T',  83 },
+  { 'E',  84 },
+  { 'D',  85 },
+  { 'O',  87 },
+  { 'T',  88 },
+  { ' ',  89 },
+  { 'I',  90 },
+  { 'P',  91 },
+  { 'I',  93 },
+  { 'S',  94 },
+  { 'C',  95 },
+  { 'O',  96 },
+  { 'N',  97 },
+  { 'N',  98 },
+  { 'E',  99 },
+  { 'C', 100 },
+  { 'T', 101 },
+  { 'e', 103 },
+  { 'a', 104 },
+  { 'd', 105 },
+  { 'y', 106 },
+  { 'C', 112 },
+  { 'I', 108 },
+  { 'P', 109 },
+  { 'D', 110 },
+  { ',', 111 },
+  { 'I', 113 },
+  { 'W', 126 },
+  { 'P', 114 },
+  { 'D', 119 },
+  { 'M', 115 },
+  { 'S', 135 },
+  { 'U', 116 },
+  { 'X', 117 },
+  { ':', 118 },
+  { 'O', 120 },
+  { 'M', 121 },
+  { 'A', 122 },
+  { 'I', 123 },
+  { 'N', 124 },
+  { ':', 125 },
+  { 'J', 127 },
+  { 'A', 128 },
+  { 'P', 129 },
+  { '_', 130 },
+  { 'C', 131 },
+  { 'U', 132 },
+  { 'R', 133 },
+  { ':', 134 },
+  { 'T', 136 },
+  { 'A', 137 },
+  { 'T', 138 },
+  { 'U', 139 },
+  { 'S', 140 },
+  { ':', 141 },
+};
+
+#endif // __REPLY_TOKENS_H__
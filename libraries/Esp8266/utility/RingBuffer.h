@@ -0,0 +1,202 @@
+/**
+ *  @file
+ *  @brief Statically sized ring buffer for received characters.
+ *  @author Joern Hoffmann <jhoffmann@informatik.uni-leipzig.de>
+ *  @author Joern Hoffmann <j.hoffmann@xceeth.com>
+ *  @version 1.0
+ *
+ *  @section LICENSE
+ *
+ *  The MIT License (MIT)
+ *  Copyright (c) 2015 Joern Hoffmann
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __RING_BUFFER_H__
+#define __RING_BUFFER_H__
+
+#include <Arduino.h>
+
+/**
+ * First in, first out buffer of characters with a fixed capacity.
+ * No heap memory is used, the storage is part of the object.
+ *
+ * @tparam SIZE The maximum count of buffered characters.
+ */
+template <unsigned SIZE>
+class RingBuffer
+{
+public:
+  RingBuffer() : _head(0), _count(0)
+  { }
+
+  /**
+   * Appends a character.
+   * @return False if the buffer is full and the character was dropped.
+   */
+  bool push(char c)
+  {
+    if (isFull())
+      return false;
+
+    _buffer[wrap(_head + _count)] = c;
+    _count++;
+    return true;
+  }
+
+  /**
+   * Removes the oldest character.
+   * @return The character or -1 if the buffer is empty.
+   */
+  int pop()
+  {
+    if (isEmpty())
+      return -1;
+
+    unsigned char c = _buffer[_head];
+    discard(1);
+    return c;
+  }
+
+  /**
+   * Appends as many characters of a buffer as fit.
+   * @return The count of appended characters.
+   */
+  unsigned write(const char *buffer, unsigned length)
+  {
+    unsigned written = 0;
+    while (written < length && push(buffer[written]))
+      written++;
+
+    return written;
+  }
+
+  /**
+   * Removes the oldest characters and copies them into a buffer.
+   * @return The count of copied characters.
+   */
+  unsigned read(char *buffer, unsigned length)
+  {
+    if (length > _count)
+      length = _count;
+
+    for (unsigned i = 0; i < length; i++)
+      buffer[i] = peek(i);
+
+    discard(length);
+    return length;
+  }
+
+  /**
+   * Returns the character at the given position without removing it.
+   * @note Position 0 is the oldest character. The position is not checked.
+   */
+  char peek(unsigned index) const
+  {
+    return _buffer[wrap(_head + index)];
+  }
+
+  /**
+   * Removes the given count of characters from the front.
+   */
+  void discard(unsigned count)
+  {
+    if (count > _count)
+      count = _count;
+
+    _head = wrap(_head + count);
+    _count -= count;
+  }
+
+  /**
+   * Removes the newest characters until the given size is reached.
+   */
+  void truncate(unsigned size)
+  {
+    if (size < _count)
+      _count = size;
+  }
+
+  void clear()
+  {
+    _head = 0;
+    _count = 0;
+  }
+
+  unsigned size() const
+  {
+    return _count;
+  }
+
+  unsigned capacity() const
+  {
+    return SIZE;
+  }
+
+  bool isEmpty() const
+  {
+    return _count == 0;
+  }
+
+  bool isFull() const
+  {
+    return _count == SIZE;
+  }
+
+  /**
+   * Compares the buffered characters with a string in program memory.
+   * @param offset The position of the first character to compare.
+   * @return True if both are equal.
+   */
+  bool equals_P(PGM_P string, unsigned offset = 0) const
+  {
+    return _count == offset + strlen_P(string) && startsWith_P(string, offset);
+  }
+
+  /**
+   * Checks if the buffered characters start with a string in program memory.
+   * @param offset The position of the first character to compare.
+   */
+  bool startsWith_P(PGM_P prefix, unsigned offset = 0) const
+  {
+    for (unsigned i = offset; ; i++, prefix++) {
+      char c = pgm_read_byte(prefix);
+      if (!c)
+        return true;
+
+      if (i >= _count || peek(i) != c)
+        return false;
+    }
+  }
+
+private:
+  char _buffer[SIZE];
+  unsigned _head;
+  unsigned _count;
+
+  // Avoids the expensive modulo on 8 bit controllers
+  static unsigned wrap(unsigned index)
+  {
+    return index >= SIZE ? index - SIZE : index;
+  }
+};
+
+#endif
@@ -0,0 +1,79 @@
+/**
+ *  @file
+ *  @brief Capabilities of the serial interface the module is connected to.
+ *  @author Joern Hoffmann <jhoffmann@informatik.uni-leipzig.de>
+ *  @author Joern Hoffmann <j.hoffmann@xceeth.com>
+ *  @version 1.0
+ *
+ *  @section LICENSE
+ *
+ *  The MIT License (MIT)
+ *  Copyright (c) 2015 Joern Hoffmann
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#ifndef __SERIAL_TRAITS_H__
+#define __SERIAL_TRAITS_H__
+
+/**
+ * Describes the serial interface T the module is connected to.
+ * Specialize the template for your serial class to unlock its capabilities,
+ * e.g. for a hardware UART that handles higher rates:
+ *
+ * @code
+ * template <>
+ * struct SerialTraits<HardwareSerial>
+ * {
+ *   static const unsigned long MAX_BAUD = 921600;
+ * };
+ * @endcode
+ */
+template <class T>
+struct SerialTraits
+{
+  static const unsigned long MAX_BAUD = 115200;   ///< Highest rate the interface handles reliably
+};
+
+/**
+ * Switches the RTS/CTS flow control of the serial interface T. Neither the
+ * SoftwareSerial nor the UART of the AVR have it, so it is unsupported by
+ * default. Specialize the template for a serial that drives RTS and stops
+ * sending while CTS is high:
+ *
+ * @code
+ * template <>
+ * struct SerialFlowControl<Uart>
+ * {
+ *   static const bool SUPPORTED = true;
+ *   static void set(Uart &serial, bool enable) { serial.setFlowControl(enable); }
+ * };
+ * @endcode
+ *
+ * @note set() is called after each begin() of the driver.
+ */
+template <class T>
+struct SerialFlowControl
+{
+  static const bool SUPPORTED = false;            ///< The interface can handle RTS and CTS
+  static void set(T &, bool) {}
+};
+
+#endif
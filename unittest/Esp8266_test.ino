@@ -33,8 +33,14 @@
 #include <ArduinoUnit.h>
 
 #include <HttpRequest.h>
+
+// Tests the optional DNS cache as well
+#define ESP8266_DNS_CACHE_SIZE 2
+#define ESP8266_DNS_CACHE_TTL 1000UL
 #include <Esp8266.h>
+#include <EspClient.h>
 #include <IPDParser.h>
+#include <utility/FakeSerial.h>
 
 SoftwareSerial mySerial(2,3); // RX, TX
 Esp8266<SoftwareSerial> esp(mySerial);
@@ -68,6 +74,136 @@ bool connectAndSendGetRequest(unsigned char channelId)
   return ret;
 }
 
+// Returns the token the matcher assigns to a whole line.
+ReplyToken matchLine(const char *line)
+{
+  ReplyMatcher matcher;
+  while (*line)
+    matcher.feed(*line++);
+
+  return matcher.token();
+}
+
+// Counts the events of the module and keeps the channel of the last one.
+unsigned eventCount;
+unsigned char eventChannel;
+
+void recordEvent(Esp8266<FakeSerial>::Event event, unsigned char channelId)
+{
+  eventCount++;
+  eventChannel = channelId;
+}
+
+// A module whose RTS/CTS lines are not wired: it answers every command with
+// "OK", but stays silent while flow control is enabled.
+class FlowControlSerial : public FakeSerial
+{
+public:
+  bool flowControl;
+
+  FlowControlSerial() : flowControl(false)
+  { }
+
+  using FakeSerial::write;
+
+  size_t write(uint8_t val)
+  {
+    FakeSerial::write(val);
+    if (val == '\n' && !flowControl)
+      nextBytes("\r\nOK\r\n");
+
+    return 1;
+  }
+
+  int available()
+  {
+    return flowControl ? 0 : FakeSerial::available();
+  }
+};
+
+template <>
+struct SerialFlowControl<FlowControlSerial>
+{
+  static const bool SUPPORTED = true;
+  static void set(FlowControlSerial &serial, bool enable) { serial.flowControl = enable; }
+};
+
+// A serial interface that handles no rate above 57600.
+class LowSpeedSerial : public FakeSerial
+{ };
+
+template <>
+struct SerialTraits<LowSpeedSerial>
+{
+  static const unsigned long MAX_BAUD = 57600;
+};
+
+// Records the commands written to the module but only counts the payload, so
+// large sends fit into the RAM of the Arduino. A command starts with 'A' and
+// ends with the line feed, so payloads must not contain an 'A'.
+class CommandSerial : public FakeSerial
+{
+public:
+  String commands;
+  unsigned long payloadBytes;
+
+  CommandSerial() : payloadBytes(0), command(false)
+  { }
+
+  using FakeSerial::write;
+
+  size_t write(uint8_t val)
+  {
+    if (val == 'A')
+      command = true;
+
+    if (command)
+      commands += (char)val;
+    else
+      payloadBytes++;
+
+    if (val == '\n')
+      command = false;
+
+    return 1;
+  }
+
+private:
+  bool command;
+};
+
+// A module that accepts every link: it answers AT+CIPSTART and AT+CIPCLOSE
+// with the messages of the link and every other command with "OK".
+class LinkSerial : public FakeSerial
+{
+public:
+  using FakeSerial::write;
+
+  size_t write(uint8_t val)
+  {
+    FakeSerial::write(val);
+    if (val != '\n') {
+      line += (char)val;
+      return 1;
+    }
+
+    if (line.startsWith("AT+CIPSTART=")) {
+      nextByte(line[12]);
+      nextBytes(",CONNECT\r\n");
+    } else if (line.startsWith("AT+CIPCLOSE=")) {
+      nextByte(line[12]);
+      nextBytes(",CLOSED\r\n");
+    }
+
+    nextBytes("\r\nOK\r\n");
+    line = "";
+    return 1;
+  }
+
+private:
+  String line;
+};
+
 // -------------------------------------------------------------------------- //
 // Tests
 // -------------------------------------------------------------------------- //
@@ -200,6 +336,725 @@ test (receive_doesNotReceiveOnTheWrongChannelId)
 }
 */
 
+test(basic_setBaud_withFlowControlOnSoftwareSerialFails)
+{
+  // SoftwareSerial has no RTS/CTS, the rate must stay untouched
+  bool ret = esp.setBaud(19200, true);
+  assertFalse(ret);
+  assertFalse(esp.isFlowControlEnabled());
+  assertTrue(esp.isOk());
+}
+
+test (basic_setBaud_withUnwiredFlowControlFallsBack)
+{
+  FlowControlSerial flowSerial;
+  Esp8266<FlowControlSerial> flowEsp(flowSerial);
+
+  bool ret = flowEsp.setBaud(19200, true);
+
+  // The new rate is kept, but without RTS/CTS
+  assertFalse(ret);
+  assertFalse(flowEsp.isFlowControlEnabled());
+  assertFalse(flowSerial.flowControl);
+  assertEqual(flowEsp.getBaud(), 19200UL);
+  assertTrue(flowSerial.getWrittenString().indexOf("AT+UART_CUR=19200,8,1,0,3\r\n") >= 0);
+  assertTrue(flowSerial.getWrittenString().indexOf("AT+UART_CUR=19200,8,1,0,0\r\n") >= 0);
+}
+
+test (basic_setBaud_aboveMaxBaudOfSerialFails)
+{
+  LowSpeedSerial lowSpeedSerial;
+  Esp8266<LowSpeedSerial> lowSpeedEsp(lowSpeedSerial);
+
+  assertFalse(lowSpeedEsp.setBaud(115200));
+  assertFalse(lowSpeedEsp.setBaud(230400));
+  assertEqual(lowSpeedSerial.getWrittenString(), String(""));
+
+  lowSpeedSerial.nextBytes("\r\nOK\r\n");
+  lowSpeedEsp.setBaud(57600);
+  assertTrue(lowSpeedSerial.getWrittenString().startsWith("AT+UART_CUR=57600,8,1,0,0\r\n"));
+}
+
+test (matcher_matchesEachToken)
+{
+  static const struct {
+    const char *line;
+    ReplyToken token;
+  } lines[] = {
+    { "> ", TOKEN_PROMPT },
+    { "OK", TOKEN_OK },
+    { "SEND OK", TOKEN_SEND_OK },
+    { "ERROR", TOKEN_ERROR },
+    { "FAIL", TOKEN_FAIL },
+    { "SEND FAIL", TOKEN_SEND_FAIL },
+    { "ALREADY CONNECTED", TOKEN_ALREADY_CONNECTED },
+    { "busy p...", TOKEN_BUSY },
+    { "busy s...", TOKEN_BUSY },
+    { "CONNECT", TOKEN_CONNECT },
+    { "CLOSED", TOKEN_CLOSED },
+    { "0,CONNECT", TOKEN_LINK_CONNECT },
+    { "4,CLOSED", TOKEN_LINK_CLOSED },
+    { "WIFI CONNECTED", TOKEN_WIFI_CONNECTED },
+    { "WIFI GOT IP", TOKEN_WIFI_GOT_IP },
+    { "WIFI DISCONNECT", TOKEN_WIFI_DISCONNECT },
+    { "ready", TOKEN_READY },
+    { "+IPD,1,5:", TOKEN_DATA },
+    { "+CIPMUX:1", TOKEN_CIPMUX },
+    { "+CIPDOMAIN:10.0.0.1", TOKEN_CIPDOMAIN },
+    { "+CWJAP_CUR:\"ssid\"", TOKEN_CWJAP_CUR },
+    { "+CIPSTATUS:0,\"TCP\"", TOKEN_CIPSTATUS }
+  };
+
+  for (unsigned i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+    assertEqual(matchLine(lines[i].line), lines[i].token);
+}
+
+test (matcher_rejectsLinesThatOnlyContainAToken)
+{
+  // A token must match the whole line; only prefix tokens take arguments
+  static const char *lines[] = {
+    "OKAY", "SEND OKAY", "ERRORS", "readyx", "CLOSED2", "O",
+    "xOK", "AT+CIPSEND OK", "link CLOSED", "data+IPD,1,5:", " ready"
+  };
+
+  for (unsigned i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+    assertEqual(matchLine(lines[i]), TOKEN_NONE);
+}
+
+test (connect_twiceReportsAlreadyConnected)
+{
+  esp.setMultipleConnections(true);
+  esp.disconnect(1);
+
+  assertTrue(esp.connect(1, F("google.de"), 80));
+  bool ret = esp.connect(1, F("google.de"), 80);
+  Esp8266<SoftwareSerial>::CommandStatus status = esp.getLastStatus();
+
+  esp.disconnect(1);
+  assertFalse(ret);
+  assertEqual(status, Esp8266<SoftwareSerial>::ALREADY_CONNECTED);
+}
+
+test (async_isOkAsync_succeedsByPolling)
+{
+  assertTrue(esp.isOkAsync());
+  assertTrue(esp.isBusy());
+
+  while (esp.poll() == Esp8266<SoftwareSerial>::PENDING)
+    ;
+
+  assertEqual(esp.getCommandStatus(), Esp8266<SoftwareSerial>::SUCCEEDED);
+}
+
+test (async_fail_finishesWithFailed)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  fakeSerial.nextBytes("\r\nFAIL\r\n");
+
+  fakeEsp.joinAccessPointAsync(F("ssid"), F("passwd"));
+  while (fakeEsp.poll() == Esp8266<FakeSerial>::PENDING)
+    ;
+
+  assertEqual(fakeEsp.getCommandStatus(), Esp8266<FakeSerial>::FAILED);
+}
+
+test (async_sendFail_finishesWithSendFailed)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  fakeSerial.nextBytes("\r\nOK\r\n> \r\nSEND FAIL\r\n");
+
+  fakeEsp.sendAsync(1, "Hello", 5);
+  while (fakeEsp.poll() == Esp8266<FakeSerial>::PENDING)
+    ;
+
+  assertEqual(fakeEsp.getCommandStatus(), Esp8266<FakeSerial>::SEND_FAILED);
+}
+
+test (async_busy_finishesWithBusy)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  fakeSerial.nextBytes("busy p...\r\n");
+
+  fakeEsp.isOkAsync();
+  while (fakeEsp.poll() == Esp8266<FakeSerial>::PENDING)
+    ;
+
+  assertEqual(fakeEsp.getCommandStatus(), Esp8266<FakeSerial>::BUSY);
+}
+
+test (async_alreadyConnected_finishesWithAlreadyConnected)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  fakeSerial.nextBytes("ALREADY CONNECTED\r\n\r\nERROR\r\n");
+
+  fakeEsp.connectAsync(1, F("10.0.0.1"), 80);
+  while (fakeEsp.poll() == Esp8266<FakeSerial>::PENDING)
+    ;
+
+  assertEqual(fakeEsp.getCommandStatus(), Esp8266<FakeSerial>::ALREADY_CONNECTED);
+}
+
+test (linkState_followsConnectAndClosed)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+
+  fakeEsp.connectAsync(0, F("10.0.0.1"), 80);
+  fakeEsp.poll();
+  assertEqual(fakeEsp.getLinkState(0), Esp8266<FakeSerial>::LINK_OPENING);
+
+  fakeSerial.nextBytes("0,CONNECT\r\n\r\nOK\r\n");
+  fakeEsp.poll();
+  assertEqual(fakeEsp.getLinkState(0), Esp8266<FakeSerial>::LINK_UP);
+
+  fakeSerial.nextBytes("0,CLOSED\r\n");
+  fakeEsp.poll();
+  assertEqual(fakeEsp.getLinkState(0), Esp8266<FakeSerial>::LINK_DOWN);
+}
+
+test (linkState_closedWhileCommandIsPending)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  fakeSerial.nextBytes("0,CONNECT\r\n");
+  fakeEsp.poll();
+  assertEqual(fakeEsp.getLinkState(0), Esp8266<FakeSerial>::LINK_UP);
+
+  // The message interleaves with the reply of an unrelated command
+  fakeEsp.isOkAsync();
+  fakeSerial.nextBytes("0,CLOSED\r\n");
+  assertEqual(fakeEsp.poll(), Esp8266<FakeSerial>::PENDING);
+  assertEqual(fakeEsp.getLinkState(0), Esp8266<FakeSerial>::LINK_DOWN);
+
+  fakeSerial.nextBytes("\r\nOK\r\n");
+  assertEqual(fakeEsp.poll(), Esp8266<FakeSerial>::SUCCEEDED);
+
+  // Data for the closed link is not sent
+  fakeEsp.sendAsync(0, "Hello", 5);
+  assertEqual(fakeEsp.getCommandStatus(), Esp8266<FakeSerial>::NOT_CONNECTED);
+}
+
+test (server_startOnAnotherPortRestartsServer)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  fakeSerial.nextBytes("\r\nOK\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.startServer(80));
+
+  // AT+CIPMUX=1 is known, the server is stopped and started again
+  fakeSerial.nextBytes("\r\nOK\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.startServer(81));
+
+  const String &written = fakeSerial.getWrittenString();
+  int start = written.indexOf("AT+CIPSERVER=1,80\r\n");
+  int stop = written.indexOf("AT+CIPSERVER=0\r\n");
+  assertMoreOrEqual(start, 0);
+  assertMore(stop, start);
+  assertMore(written.indexOf("AT+CIPSERVER=1,81\r\n"), stop);
+
+  // The same port needs no command
+  unsigned length = written.length();
+  assertTrue(fakeEsp.startServer(81));
+  assertEqual(fakeSerial.getWrittenString().length(), length);
+}
+
+test (send_largePayloadIsSentInPackets)
+{
+  CommandSerial fakeSerial;
+  Esp8266<CommandSerial> fakeEsp(fakeSerial);
+
+  // 5000 bytes from one buffer
+  char chunk[100];
+  memset(chunk, 'x', sizeof(chunk));
+  Esp8266<CommandSerial>::Segment segments[50];
+  for (unsigned i = 0; i < 50; i++) {
+    segments[i].data = chunk;
+    segments[i].length = sizeof(chunk);
+    segments[i].progmem = false;
+  }
+
+  for (unsigned i = 0; i < 3; i++)
+    fakeSerial.nextBytes("\r\nOK\r\n> \r\nSEND OK\r\n");
+
+  Esp8266<CommandSerial>::CommandId id = fakeEsp.sendAsync(1, segments, 50);
+  while (fakeEsp.poll() == Esp8266<CommandSerial>::PENDING)
+    ;
+
+  assertEqual(fakeEsp.getCommandStatus(id), Esp8266<CommandSerial>::SUCCEEDED);
+  assertEqual(fakeEsp.getDeliveredBytes(id), 5000);
+  assertEqual(fakeSerial.payloadBytes, 5000UL);
+  assertEqual(fakeSerial.commands, String("AT+CIPSEND=1,2048\r\nAT+CIPSEND=1,2048\r\nAT+CIPSEND=1,904\r\n"));
+}
+
+test (send_failedPacketReportsDeliveredBytes)
+{
+  CommandSerial fakeSerial;
+  Esp8266<CommandSerial> fakeEsp(fakeSerial);
+
+  char chunk[100];
+  memset(chunk, 'x', sizeof(chunk));
+  Esp8266<CommandSerial>::Segment segments[50];
+  for (unsigned i = 0; i < 50; i++) {
+    segments[i].data = chunk;
+    segments[i].length = sizeof(chunk);
+    segments[i].progmem = false;
+  }
+
+  // The second packet fails, the third is never announced
+  fakeSerial.nextBytes("\r\nOK\r\n> \r\nSEND OK\r\n");
+  fakeSerial.nextBytes("\r\nOK\r\n> \r\nSEND FAIL\r\n");
+
+  Esp8266<CommandSerial>::CommandId id = fakeEsp.sendAsync(1, segments, 50);
+  while (fakeEsp.poll() == Esp8266<CommandSerial>::PENDING)
+    ;
+
+  assertEqual(fakeEsp.getCommandStatus(id), Esp8266<CommandSerial>::SEND_FAILED);
+  assertEqual(fakeEsp.getDeliveredBytes(id), 2048);
+  assertEqual(fakeSerial.commands, String("AT+CIPSEND=1,2048\r\nAT+CIPSEND=1,2048\r\n"));
+}
+
+test (format_connectPrintsProtocolAndQuotedAddress)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  fakeSerial.nextBytes("\r\nOK\r\n");
+  fakeEsp.connect(1, F("10.0.0.1"), 80);
+  fakeSerial.nextBytes("\r\nOK\r\n");
+  fakeEsp.connect(2, F("10.0.0.2"), 53, Esp8266<FakeSerial>::UDP);
+  fakeSerial.nextBytes("\r\nOK\r\n\r\nOK\r\n");
+  fakeEsp.connect(3, F("10.0.0.3"), 443, Esp8266<FakeSerial>::TLS);
+
+  assertEqual(fakeSerial.getWrittenString(), String(
+    "AT+CIPSTART=1,\"TCP\",\"10.0.0.1\",80\r\n"
+    "AT+CIPSTART=2,\"UDP\",\"10.0.0.2\",53\r\n"
+    "AT+CIPSSLSIZE=4096\r\n"
+    "AT+CIPSTART=3,\"SSL\",\"10.0.0.3\",443\r\n"));
+}
+
+test (format_joinAccessPointQuotesStrings)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+
+  fakeEsp.joinAccessPointAsync(F("my ssid"), F("pass,word"));
+  while (fakeEsp.isBusy()) {
+    fakeSerial.nextBytes("\r\nOK\r\n");
+    fakeEsp.poll();
+  }
+
+  assertMoreOrEqual(fakeSerial.getWrittenString().indexOf("AT+CWJAP_CUR=\"my ssid\",\"pass,word\"\r\n"), 0);
+}
+
+test (format_sendDatagramPrintsRemote)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+
+  fakeEsp.sendDatagramAsync(2, "abc", 3, 0x0100000aUL, 7);
+
+  assertEqual(fakeSerial.getWrittenString(), String("AT+CIPSEND=2,3,\"10.0.0.1\",7\r\n"));
+}
+
+test (format_overflowTruncatesCommand)
+{
+  RingBuffer<8> buffer;
+  RingBufferWriter<8> writer(buffer);
+
+  writer.print(F("AT+CIPSTART"));
+
+  assertTrue(writer.overflow());
+  assertEqual(writer.written(), 8);
+  assertEqual(buffer.size(), 8);
+  assertEqual(writer.write('x'), 0);
+
+  // A command that does not fit into the command buffer is not queued
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  char ssid[ESP8266_COMMAND_BUFFER_SIZE + 1];
+  memset(ssid, 's', sizeof(ssid) - 1);
+  ssid[sizeof(ssid) - 1] = 0;
+
+  assertEqual(fakeEsp.joinAccessPointAsync(ssid, F("passwd")), 0);
+  assertFalse(fakeEsp.isBusy());
+  assertEqual(fakeSerial.getWrittenString(), String(""));
+}
+
+test (state_knownSettingsAreNotSentAgain)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+
+  fakeSerial.nextBytes("\r\nOK\r\n");
+  assertTrue(fakeEsp.setMultipleConnections(true));
+  assertTrue(fakeEsp.setMultipleConnections(true));
+  bool multipleConnections = false;
+  assertTrue(fakeEsp.getMultipleConnections(multipleConnections));
+  assertTrue(multipleConnections);
+
+  for (unsigned i = 0; i < 2; i++) {
+    fakeEsp.joinAccessPointAsync(F("ssid"), F("passwd"));
+    while (fakeEsp.isBusy()) {
+      fakeSerial.nextBytes("\r\nOK\r\n");
+      fakeEsp.poll();
+    }
+  }
+
+  assertEqual(fakeSerial.getWrittenString(), String(
+    "AT+CIPMUX=1\r\n"
+    "AT+CWMODE_CUR=1\r\n"
+    "AT+CWJAP_CUR=\"ssid\",\"passwd\"\r\n"
+    "AT+CWJAP_CUR=\"ssid\",\"passwd\"\r\n"));
+}
+
+test (state_sslSizeIsSentAgainAfterReset)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+
+  fakeSerial.nextBytes("\r\nOK\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.connect(1, F("10.0.0.1"), 443, Esp8266<FakeSerial>::TLS));
+  fakeSerial.nextBytes("\r\nOK\r\n");
+  assertTrue(fakeEsp.connect(2, F("10.0.0.1"), 443, Esp8266<FakeSerial>::TLS));
+
+  assertEqual(fakeSerial.getWrittenString(), String(
+    "AT+CIPSSLSIZE=4096\r\n"
+    "AT+CIPSTART=1,\"SSL\",\"10.0.0.1\",443\r\n"
+    "AT+CIPSTART=2,\"SSL\",\"10.0.0.1\",443\r\n"));
+
+  fakeSerial.nextBytes("ready\r\n");
+  fakeEsp.poll();
+  fakeSerial.nextBytes("\r\nOK\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.connect(1, F("10.0.0.1"), 443, Esp8266<FakeSerial>::TLS));
+
+  assertEqual(fakeSerial.getWrittenString(), String(
+    "AT+CIPSSLSIZE=4096\r\n"
+    "AT+CIPSTART=1,\"SSL\",\"10.0.0.1\",443\r\n"
+    "AT+CIPSTART=2,\"SSL\",\"10.0.0.1\",443\r\n"
+    "AT+CIPSSLSIZE=4096\r\n"
+    "AT+CIPSTART=1,\"SSL\",\"10.0.0.1\",443\r\n"));
+}
+
+test (state_isClearedByTheLossOfTheAccessPoint)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+
+  fakeSerial.nextBytes("\r\nOK\r\n");
+  assertTrue(fakeEsp.setMultipleConnections(true));
+  assertTrue(fakeEsp.setMultipleConnections(true));
+
+  fakeSerial.nextBytes("WIFI DISCONNECT\r\n");
+  fakeEsp.poll();
+  fakeSerial.nextBytes("\r\nOK\r\n");
+  assertTrue(fakeEsp.setMultipleConnections(true));
+
+  assertEqual(fakeSerial.getWrittenString(), String("AT+CIPMUX=1\r\nAT+CIPMUX=1\r\n"));
+}
+
+test (pool_openLinkReusesLink)
+{
+  LinkSerial linkSerial;
+  Esp8266<LinkSerial> linkEsp(linkSerial);
+
+  assertEqual(linkEsp.openLink(F("10.0.0.1"), 80), 0);
+  assertEqual(linkEsp.openLink(F("10.0.0.1"), 80), 0);
+  assertEqual(linkEsp.openLink(F("10.0.0.1"), 81), 1);
+
+  assertEqual(linkSerial.getWrittenString(), String(
+    "AT+CIPSTART=0,\"TCP\",\"10.0.0.1\",80\r\n"
+    "AT+CIPSTART=1,\"TCP\",\"10.0.0.1\",81\r\n"));
+}
+
+test (pool_openLinkClosesLeastRecentlyUsedLink)
+{
+  LinkSerial linkSerial;
+  Esp8266<LinkSerial> linkEsp(linkSerial);
+  const char *hosts[] = { "10.0.0.1", "10.0.0.2", "10.0.0.3", "10.0.0.4", "10.0.0.5" };
+
+  for (unsigned i = 0; i < ESP8266_CHANNEL_COUNT; i++) {
+    assertEqual(linkEsp.openLink(hosts[i], 80), i);
+    delay(10);
+  }
+
+  // Channel 0 is used again, so channel 1 is the least recently used
+  assertEqual(linkEsp.openLink(hosts[0], 80), 0);
+  delay(10);
+
+  assertEqual(linkEsp.openLink(F("10.0.0.6"), 80), 1);
+  assertTrue(linkSerial.getWrittenString().endsWith(
+    "AT+CIPSTART=4,\"TCP\",\"10.0.0.5\",80\r\n"
+    "AT+CIPCLOSE=1\r\n"
+    "AT+CIPSTART=1,\"TCP\",\"10.0.0.6\",80\r\n"));
+}
+
+test (pool_closedLinkIsNotReused)
+{
+  LinkSerial linkSerial;
+  Esp8266<LinkSerial> linkEsp(linkSerial);
+
+  assertEqual(linkEsp.openLink(F("10.0.0.1"), 80), 0);
+  linkSerial.nextBytes("0,CLOSED\r\n");
+  linkEsp.poll();
+  assertEqual(linkEsp.openLink(F("10.0.0.1"), 80), 0);
+
+  assertEqual(linkSerial.getWrittenString(), String(
+    "AT+CIPSTART=0,\"TCP\",\"10.0.0.1\",80\r\n"
+    "AT+CIPSTART=0,\"TCP\",\"10.0.0.1\",80\r\n"));
+}
+
+test (dns_resolvedAddressIsCached)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  unsigned long address = 0;
+
+  fakeSerial.nextBytes("+CIPDOMAIN:93.184.216.34\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.resolve(F("example.com"), address));
+  assertEqual(address, 0x22d8b85dUL);
+
+  // A hit needs no lookup, a miss does
+  address = 0;
+  assertTrue(fakeEsp.resolve(F("example.com"), address));
+  assertEqual(address, 0x22d8b85dUL);
+  assertFalse(fakeEsp.resolve(F("example.org"), address));
+
+  assertEqual(fakeSerial.getWrittenString(), String(
+    "AT+CIPDOMAIN=\"example.com\"\r\n"
+    "AT+CIPDOMAIN=\"example.org\"\r\n"));
+}
+
+test (dns_cachedAddressIsUsedToConnect)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+
+  unsigned long address;
+
+  fakeSerial.nextBytes("+CIPDOMAIN:93.184.216.34\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.resolve(F("example.com"), address));
+  fakeSerial.nextBytes("1,CONNECT\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.connect(1, F("example.com"), 80));
+
+  assertEqual(fakeSerial.getWrittenString(), String(
+    "AT+CIPDOMAIN=\"example.com\"\r\n"
+    "AT+CIPSTART=1,\"TCP\",\"93.184.216.34\",80\r\n"));
+}
+
+test (dns_expiredAddressIsResolvedAgain)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  unsigned long address;
+
+  fakeSerial.nextBytes("+CIPDOMAIN:93.184.216.34\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.resolve(F("example.com"), address));
+  delay(ESP8266_DNS_CACHE_TTL + 1);
+  fakeSerial.nextBytes("+CIPDOMAIN:93.184.216.35\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.resolve(F("example.com"), address));
+  assertEqual(address, 0x23d8b85dUL);
+
+  assertEqual(fakeSerial.getWrittenString(), String(
+    "AT+CIPDOMAIN=\"example.com\"\r\n"
+    "AT+CIPDOMAIN=\"example.com\"\r\n"));
+}
+
+test (dns_collidingNamesAreToldApart)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  unsigned long address;
+
+  // "costarring" and "liquid" have the same FNV-1a hash
+  fakeSerial.nextBytes("+CIPDOMAIN:10.0.0.1\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.resolve(F("costarring"), address));
+  fakeSerial.nextBytes("+CIPDOMAIN:10.0.0.2\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.resolve(F("liquid"), address));
+  assertEqual(address, 0x0200000aUL);
+
+  assertTrue(fakeEsp.resolve(F("costarring"), address));
+  assertEqual(address, 0x0100000aUL);
+
+  assertEqual(fakeSerial.getWrittenString(), String(
+    "AT+CIPDOMAIN=\"costarring\"\r\n"
+    "AT+CIPDOMAIN=\"liquid\"\r\n"));
+}
+
+test (datagram_backToBackDatagramsKeepTheirSenders)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  char buffer[8];
+  unsigned long address;
+  unsigned port;
+
+  fakeSerial.nextBytes("0,CONNECT\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.openDatagram(0, F("10.0.0.1"), 7, 1000));
+
+  fakeSerial.nextBytes("\r\n+IPD,0,3,10.0.0.2,1234:abc\r\n+IPD,0,2,10.0.0.3,5678:de");
+  fakeEsp.poll();
+
+  assertEqual(fakeEsp.readDatagram(0, buffer, sizeof(buffer), address, port), 3);
+  assertEqual(strncmp(buffer, "abc", 3), 0);
+  assertEqual(address, 0x0200000aUL);
+  assertEqual(port, 1234);
+
+  assertEqual(fakeEsp.readDatagram(0, buffer, sizeof(buffer), address, port), 2);
+  assertEqual(strncmp(buffer, "de", 2), 0);
+  assertEqual(address, 0x0300000aUL);
+  assertEqual(port, 5678);
+
+  assertEqual(fakeEsp.readDatagram(0, buffer, sizeof(buffer), address, port), 0);
+}
+
+test (datagram_longDatagramIsTruncated)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  char buffer[4];
+  unsigned long address;
+  unsigned port;
+
+  fakeSerial.nextBytes("0,CONNECT\r\n\r\nOK\r\n");
+  assertTrue(fakeEsp.openDatagram(0, F("10.0.0.1"), 7, 1000));
+
+  fakeSerial.nextBytes("\r\n+IPD,0,10,10.0.0.2,1234:0123456789\r\n+IPD,0,2,10.0.0.2,1234:ab");
+  fakeEsp.poll();
+
+  // The rest of the first datagram is dropped, not read as the next one
+  assertEqual(fakeEsp.readDatagram(0, buffer, sizeof(buffer), address, port), 4);
+  assertEqual(strncmp(buffer, "0123", 4), 0);
+  assertEqual(fakeEsp.readDatagram(0, buffer, sizeof(buffer), address, port), 2);
+  assertEqual(strncmp(buffer, "ab", 2), 0);
+}
+
+test (client_writesAreCoalesced)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  EspClient<FakeSerial> client(fakeEsp, 1);
+
+  fakeSerial.nextBytes("1,CONNECT\r\n\r\nOK\r\n");
+  assertEqual(client.connect("10.0.0.1", 80), 1);
+
+  client.print(F("GET / HTTP/1.0\r\n"));
+  client.print(F("\r\n"));
+  assertEqual(fakeSerial.getWrittenString(), String("AT+CIPSTART=1,\"TCP\",\"10.0.0.1\",80\r\n"));
+
+  fakeSerial.nextBytes("\r\nOK\r\n> \r\nSEND OK\r\n");
+  client.flush();
+  assertEqual(fakeSerial.getWrittenString(), String(
+    "AT+CIPSTART=1,\"TCP\",\"10.0.0.1\",80\r\n"
+    "AT+CIPSEND=1,18\r\n"
+    "GET / HTTP/1.0\r\n\r\n"));
+}
+
+test (client_availableSendsBufferedDataFirst)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  EspClient<FakeSerial> client(fakeEsp, 1);
+
+  fakeSerial.nextBytes("1,CONNECT\r\n\r\nOK\r\n");
+  assertEqual(client.connect("10.0.0.1", 80), 1);
+
+  client.print(F("ping"));
+  fakeSerial.nextBytes("\r\nOK\r\n> \r\nSEND OK\r\n\r\n+IPD,1,4:pong");
+  assertEqual(client.available(), 4);
+  assertEqual(fakeSerial.getWrittenString(), String(
+    "AT+CIPSTART=1,\"TCP\",\"10.0.0.1\",80\r\n"
+    "AT+CIPSEND=1,4\r\n"
+    "ping"));
+  assertEqual(client.read(), 'p');
+}
+
+test (client_isNotConnectedAfterClosedOnceDataIsRead)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  EspClient<FakeSerial> client(fakeEsp, 1);
+
+  fakeSerial.nextBytes("1,CONNECT\r\n\r\nOK\r\n");
+  assertEqual(client.connect("10.0.0.1", 80), 1);
+  assertEqual(client.connected(), 1);
+
+  fakeSerial.nextBytes("\r\n+IPD,1,2:ab\r\n1,CLOSED\r\n");
+  fakeEsp.poll();
+  assertFalse(client);
+
+  // Received data is left to read
+  assertEqual(client.connected(), 1);
+  assertEqual(client.read(), 'a');
+  assertEqual(client.read(), 'b');
+  assertEqual(client.connected(), 0);
+}
+
+test (parser_overrunByNextHeaderIsCounted)
+{
+  FakeStreamBuffer stream;
+  IPDParser parser(stream);
+  char buffer[16];
+
+  // The module dropped 16 bytes of the first payload
+  stream.nextBytes("\r\n+IPD,1,20:abcd\r\n+IPD,1,3:xyz");
+  assertTrue(parser.parse());
+  assertEqual(parser.readPayload(buffer, sizeof(buffer)), 4);
+  assertEqual(strncmp(buffer, "abcd", 4), 0);
+
+  IPDParser::ReceiveCounters counters = parser.getReceiveCounters(1);
+  assertEqual(counters.overruns, 1);
+  assertEqual(counters.lostBytes, 16);
+
+  assertTrue(parser.parse());
+  assertEqual(parser.getChannelId(), 1);
+  assertEqual(parser.readPayload(buffer, sizeof(buffer)), 3);
+  assertEqual(strncmp(buffer, "xyz", 3), 0);
+}
+
+test (parser_heldBackCharactersArePayload)
+{
+  FakeStreamBuffer stream;
+  IPDParser parser(stream);
+  char buffer[4];
+
+  stream.nextBytes("\r\n+IPD,1,9:a\r\n+IPx,b");
+  assertTrue(parser.parse());
+  assertEqual(parser.getPayload(), String("a\r\n+IPx,b"));
+
+  IPDParser::ReceiveCounters counters = parser.getReceiveCounters(1);
+  assertEqual(counters.overruns, 0);
+
+  // A buffer shorter than the held back characters gets them piece by piece
+  stream.nextBytes("\r\n+IPD,1,6:\r\n+IPD");
+  assertTrue(parser.parse());
+  assertEqual(parser.readPayload(buffer, sizeof(buffer)), 4);
+  assertEqual(strncmp(buffer, "\r\n+I", 4), 0);
+  assertEqual(parser.readPayload(buffer, sizeof(buffer)), 2);
+  assertEqual(strncmp(buffer, "PD", 2), 0);
+}
+
+test (linkState_ignoresUnknownChannel)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  fakeEsp.setEventHandler(Esp8266<FakeSerial>::LINK_CONNECTED, recordEvent);
+  fakeEsp.setEventHandler(Esp8266<FakeSerial>::LINK_CLOSED, recordEvent);
+  eventCount = 0;
+
+  fakeSerial.nextBytes("5,CONNECT\r\n9,CONNECT\r\n7,CLOSED\r\n");
+  fakeEsp.poll();
+  assertEqual(eventCount, 0);
+
+  fakeSerial.nextBytes("4,CONNECT\r\n");
+  fakeEsp.poll();
+  assertEqual(eventCount, 1);
+  assertEqual(eventChannel, 4);
+  assertTrue(fakeEsp.isConnected(4));
+}
+
 test (receive_correctlyReceivesString)
 {
   assertTrue(connectAndSendGetRequest(1));
@@ -216,6 +1071,63 @@ test (receive_correctlyReceivesString)
   assertMore(atoi(buffer), 0);
 }
 
+test (receive_buffersDataPerChannel)
+{
+  assertTrue(connectAndSendGetRequest(2));
+
+  // Wait for the reply of the server
+  unsigned long until = millis() + Esp8266<SoftwareSerial>::MEDIUM_TIMEOUT;
+  while (!esp.available(2) && isFuture(until))
+    esp.poll();
+
+  char buffer[20];
+  unsigned length = esp.read(2, buffer, sizeof(buffer));
+
+  assertMore(length, 0);
+  assertEqual(esp.available(1), 0);
+}
+
+test (receive_overrunByPauseIsCounted)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  fakeSerial.nextBytes("+IPD,4,10:abc");
+  fakeEsp.poll();
+
+  // The rest of the payload never arrives
+  delay(Esp8266<FakeSerial>::IPD_TIMEOUT + 10);
+  fakeEsp.poll();
+
+  Esp8266<FakeSerial>::ReceiveCounters counters = fakeEsp.getReceiveCounters(4);
+  assertEqual(counters.overruns, 1);
+  assertEqual(counters.lostBytes, 7);
+
+  // The next message is read in sync
+  fakeSerial.nextBytes("+IPD,4,2:hi");
+  fakeEsp.poll();
+
+  char buffer[10];
+  assertEqual(fakeEsp.read(4, buffer, sizeof(buffer)), 5);
+  assertEqual(strncmp(buffer, "abchi", 5), 0);
+}
+
+test (receive_overrunByNextHeaderIsCounted)
+{
+  FakeSerial fakeSerial;
+  Esp8266<FakeSerial> fakeEsp(fakeSerial);
+  fakeSerial.nextBytes("+IPD,4,10:abc+IPD,4,2:hi");
+  fakeEsp.poll();
+
+  Esp8266<FakeSerial>::ReceiveCounters counters = fakeEsp.getReceiveCounters(4);
+  assertEqual(counters.overruns, 1);
+  assertEqual(counters.lostBytes, 7);
+
+  // The header is not taken as payload
+  char buffer[10];
+  assertEqual(fakeEsp.read(4, buffer, sizeof(buffer)), 5);
+  assertEqual(strncmp(buffer, "abchi", 5), 0);
+}
+
 /*
 test (receive_correctlyReceivesFakeString)
 {